@@ -0,0 +1,251 @@
+// assembler throughput benchmark over a generated route corpus
+//
+// Usage: asmbench [-n runs] [--lines n] [-o file]
+// Routes of three kinds are generated at n/100, n/10 and n lines,
+// n defaulting to 200000: survey is mostly waypoints, control is
+// nested loops and branches, variables uses every variable slot.
+// Each is written to a temporary file and timed in phases:
+//  read    map the file and touch every page
+//  lex     split every line into tokens
+//  parse   lex, parse and check into instructions
+//  encode  serialize instructions into a buffer
+//  write   write the output file
+// The best of the runs for each phase is reported as JSON on
+// stdout, or to file with -o. Keys and their order are fixed and
+// the corpus is the same on every platform, so reports from
+// different releases can be compared directly.
+
+#include "routeasm.h"
+#include "lexer.h"
+
+#include <chrono>
+#include <functional>
+
+// generated routes must not depend on the standard library's
+// distributions, which differ between implementations
+struct Random {
+	uint64_t state;
+	uint32_t next() {
+		state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+		return (uint32_t)(state >> 33);
+	}
+	int32_t below(int32_t n) { return (int32_t)(next() % (uint32_t)n); }
+};
+
+
+// lawnmower survey of waypoints with the odd comment and loiter
+std::string surveyRoute(INT_T lines) {
+	Random random = { 1 };
+	std::string out = "; survey\nINTEGER passes 2\n";
+	char line[96];
+	float x = 0, y = 0;
+	for (INT_T i = 0; i < lines - 4; ++i) {
+		if (i % 50 == 49) {
+			out.append("; next row\n");
+			x += 12.5f;
+			continue;
+		}
+		y += (i / 50) % 2 ? -2.5f : 2.5f;
+		float z = -30.0f - random.below(500) / 100.0f;
+		snprintf(line, sizeof(line), "POINT %.2f %.2f %.2f\n", x, y, z);
+		out.append(line);
+	}
+	out.append("LAND\nEND\n");
+	return out;
+}
+
+
+// repeated nests of loops, branches and arithmetic
+std::string controlRoute(INT_T lines) {
+	Random random = { 2 };
+	std::string out = "INTEGER i 0\nINTEGER acc 0\nINTEGER k 4\n";
+	char line[64];
+	INT_T count = 3;
+	while (count + 16 < lines) {
+		snprintf(line, sizeof(line), "FOR %d\n", (int)random.below(9) + 1);
+		out.append(line);
+		out.append("\tIF_POS acc\n");
+		snprintf(line, sizeof(line), "\t\tADD_ASSIGN acc %d\n", (int)random.below(100));
+		out.append(line);
+		out.append("\tENDIF\n");
+		out.append("\tWHILE\n");
+		out.append("\t\tDECREMENT acc\n");
+		out.append("\t\tIF_NEG acc\n");
+		out.append("\t\t\tBREAK_WHILE\n");
+		out.append("\t\tENDIF\n");
+		out.append("\tENDWHILE\n");
+		out.append("\tFOR_VAR k\n");
+		out.append("\t\tINC i\n");
+		out.append("\t\tMUL acc k i\n");
+		out.append("\tENDFOR\n");
+		out.append("ENDFOR\n");
+		count += 15;
+	}
+	out.append("END\n");
+	return out;
+}
+
+
+// every slot declared with a long name, then arithmetic across them
+std::string variablesRoute(INT_T lines) {
+	Random random = { 3 };
+	std::string out;
+	char line[128];
+	INT_T slots = SymbolTable::MAX_SYMBOLS;
+	for (INT_T i = 0; i < slots; ++i) {
+		snprintf(line, sizeof(line), "INTEGER mission_counter_%d %d\n", (int)i, (int)random.below(1000));
+		out.append(line);
+	}
+	const char* operations[] = { "ADD", "SUB", "MUL", "ASSIGN", "ADD_ASSIGN", "INC" };
+	for (INT_T i = slots; i < lines - 1; ++i) {
+		INT_T operation = random.below(6);
+		int a = random.below(slots), b = random.below(slots), c = random.below(slots);
+		if (operation < 3) snprintf(line, sizeof(line), "%s mission_counter_%d mission_counter_%d mission_counter_%d\n", operations[operation], a, b, c);
+		else if (operation == 3) snprintf(line, sizeof(line), "ASSIGN mission_counter_%d mission_counter_%d\n", a, b);
+		else if (operation == 4) snprintf(line, sizeof(line), "ADD_ASSIGN mission_counter_%d %d\n", a, (int)random.below(64));
+		else snprintf(line, sizeof(line), "INC mission_counter_%d\n", a);
+		out.append(line);
+	}
+	out.append("END\n");
+	return out;
+}
+
+
+struct Phase {
+	const char* name;
+	double seconds;
+};
+
+
+// best time of runs calls of work
+double best(INT_T runs, const std::function<void()>& work) {
+	double fastest = 1e300;
+	for (INT_T i = 0; i < runs; ++i) {
+		auto start = std::chrono::steady_clock::now();
+		work();
+		auto stop = std::chrono::steady_clock::now();
+		fastest = MIN_2(std::chrono::duration<double>(stop - start).count(), fastest);
+	}
+	return fastest;
+}
+
+
+int main(int argc, char** argv) {
+	namespace fs = std::filesystem;
+	INT_T runs = 5;
+	INT_T lines = 200000;
+	std::string outputfile;
+
+	for (INT_T i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+			runs = atoi(argv[++i]);
+			if (runs < 1) runs = 1;
+		}
+		else if (strcmp(argv[i], "--lines") == 0 && i + 1 < argc) {
+			lines = atoi(argv[++i]);
+			if (lines < 1000) lines = 1000;
+		}
+		else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) outputfile = argv[++i];
+		else {
+			std::cout << "Usage: asmbench [-n runs] [--lines n] [-o file]\n";
+			return -1;
+		}
+	}
+
+	std::error_code error;
+	fs::path directory = fs::temp_directory_path(error) / "routeasm-bench";
+	fs::create_directories(directory, error);
+	if (error) {
+		std::cout << "Error: could not create " << directory.string() << "\n";
+		return -1;
+	}
+
+	struct Kind {
+		const char* name;
+		std::string (*generate)(INT_T);
+	};
+	const Kind kinds[] = { { "survey", surveyRoute }, { "control", controlRoute }, { "variables", variablesRoute } };
+	const INT_T sizes[] = { lines / 100, lines / 10, lines };
+
+	std::string json;
+	char buffer[256];
+	snprintf(buffer, sizeof(buffer), "{\n  \"version\": \"%s\",\n  \"runs\": %d,\n  \"corpora\": [", ROUTEASM_VERSION, (int)runs);
+	json.append(buffer);
+
+	bool first = true;
+	for (auto& kind : kinds) {
+		for (INT_T size : sizes) {
+			std::string route = kind.generate(size);
+			INT_T count = std::count(route.begin(), route.end(), '\n');
+			std::string inputpath = (directory / (std::string(kind.name) + ".route")).string();
+			std::string outputpath = (directory / (std::string(kind.name) + ".bin")).string();
+			writeStringToFile(inputpath, route);
+
+			MappedFile source;
+			if (!source.open(inputpath)) {
+				std::cout << "Error opening file: " << inputpath << "\n";
+				return -1;
+			}
+
+			Assembler assembler;
+			if (!assembler.build(inputpath, source.view())) {
+				std::string log;
+				assembler.diagnostics.format(log);
+				std::cout << log;
+				return -1;
+			}
+			std::vector<uint8_t> output(assembler.serializedSize());
+
+			// results are summed so no phase can be optimized away
+			volatile size_t sink = 0;
+			Phase phases[] = {
+				{ "read", best(runs, [&] {
+					MappedFile file;
+					file.open(inputpath);
+					size_t sum = 0;
+					for (size_t i = 0; i < file.size(); i += 4096) sum += file.data()[i];
+					sink = sink + sum;
+				}) },
+				{ "lex", best(runs, [&] {
+					Lexer lexer(source.view());
+					size_t tokens = 0;
+					while (lexer.nextLine()) {
+						while (!lexer.nextToken().empty()) ++tokens;
+					}
+					sink = sink + tokens;
+				}) },
+				{ "parse", best(runs, [&] {
+					assembler.build(inputpath, source.view());
+					sink = sink + assembler.instructions.size();
+				}) },
+				{ "encode", best(runs, [&] {
+					assembler.serialize(output.data());
+					sink = sink + output[0];
+				}) },
+				{ "write", best(runs, [&] {
+					writeDataToFile(outputpath, output.data(), output.size());
+				}) }
+			};
+
+			snprintf(buffer, sizeof(buffer), "%s\n    {\n      \"name\": \"%s\",\n      \"lines\": %lld,\n      \"bytes\": %zu,\n      \"output_bytes\": %zu,\n      \"phases\": {",
+				first ? "" : ",", kind.name, (long long)count, route.size(), output.size());
+			json.append(buffer);
+			first = false;
+
+			// rates are of source lines and bytes for every phase so they compare
+			for (INT_T i = 0; i < 5; ++i) {
+				double seconds = MAX_2(phases[i].seconds, 1e-9);
+				snprintf(buffer, sizeof(buffer), "%s\n        \"%s\": { \"seconds\": %.6f, \"lines_per_sec\": %.0f, \"mb_per_sec\": %.1f }",
+					i ? "," : "", phases[i].name, phases[i].seconds, count / seconds, route.size() / seconds / 1e6);
+				json.append(buffer);
+			}
+			json.append("\n      }\n    }");
+		}
+	}
+	json.append("\n  ]\n}\n");
+
+	fs::remove_all(directory, error);
+	if (outputfile.empty()) std::cout << json;
+	else writeStringToFile(outputfile, json);
+	return 0;
+}
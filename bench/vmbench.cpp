@@ -0,0 +1,117 @@
+// route interpreter throughput benchmark
+//
+// Usage: vmbench [-n runs] [--budget steps] [--jumps] [--reuse-slots] [file]
+// file is route source, or an assembled program if it ends in .bin.
+// Without a file a built in loop heavy route is used.
+// The budget defaults to 10^8 steps so endless routes still finish.
+// --jumps assembles source with resolved jump offsets, and
+// --reuse-slots with variables sharing slots.
+
+#include "routeasm.h"
+#include "vm.h"
+
+#include <chrono>
+
+// nested loops with arithmetic, branches and waypoints
+const char* defaultRoute =
+	"INTEGER i 0\n"
+	"INTEGER acc 0\n"
+	"INTEGER k 4\n"
+	"FOR 20000\n"
+	"	FOR_VAR k\n"
+	"		ADD_ASSIGN acc 7\n"
+	"		MUL acc k i\n"
+	"		IF_POS i\n"
+	"			SUB_ASSIGN acc 1\n"
+	"		ENDIF\n"
+	"		POINT 1 2 3\n"
+	"	ENDFOR\n"
+	"	INCREMENT i\n"
+	"	ASSIGN acc i\n"
+	"ENDFOR\n"
+	"LAND\n"
+	"END\n";
+
+
+int main(int argc, char** argv) {
+	INT_T runs = 10;
+	uint64_t budget = 100000000;
+	std::string file;
+	AssemblerOptions options;
+
+	for (INT_T i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+			runs = atoi(argv[++i]);
+			if (runs < 1) runs = 1;
+		}
+		else if (strcmp(argv[i], "--budget") == 0 && i + 1 < argc) budget = strtoull(argv[++i], nullptr, 10);
+		else if (strcmp(argv[i], "--jumps") == 0) options.jumpOffsets = true;
+		else if (strcmp(argv[i], "--reuse-slots") == 0) options.reuseSlots = true;
+		else file = argv[i];
+	}
+
+	std::vector<uint8_t> program;
+	if (file.empty()) {
+		Assembler assembler;
+		assembler.options = options;
+		if (!assembler.assemble("default", defaultRoute)) {
+			std::string log;
+			assembler.diagnostics.format(log);
+			std::cout << log;
+			return -1;
+		}
+		program = assembler.data;
+	}
+	else {
+		MappedFile source;
+		if (!source.open(file)) {
+			std::cout << "Error opening file: " << file << "\n";
+			return -1;
+		}
+		if (file.size() >= 4 && file.compare(file.size() - 4, 4, ".bin") == 0) {
+			program.assign(source.data(), source.data() + source.size());
+		}
+		else {
+			Assembler assembler;
+			assembler.options = options;
+			if (!assembler.assemble(file, source.view())) {
+				std::string log;
+				assembler.diagnostics.format(log);
+				std::cout << log;
+				return -1;
+			}
+			program = assembler.data;
+		}
+	}
+
+	RouteVm vm;
+	if (!vm.load(program.data(), program.size())) {
+		std::cout << "Error: " << vm.loadError() << " at offset " << vm.loadErrorOffset() << "\n";
+		return -1;
+	}
+
+	// one run recording events to report what the route does
+	std::vector<RouteEvent> events;
+	VmResult result = vm.run(budget, &events);
+
+	// timed runs without recording, best run is reported
+	double best = 1e300;
+	for (INT_T i = 0; i < runs; ++i) {
+		auto start = std::chrono::steady_clock::now();
+		vm.run(budget);
+		auto stop = std::chrono::steady_clock::now();
+		best = MIN_2(std::chrono::duration<double>(stop - start).count(), best);
+	}
+
+	const char* status = result.status == VM_END ? "end" : result.status == VM_BUDGET ? "budget" : "error";
+	printf("program bytes:     %zu\n", program.size());
+	printf("instructions:      %zu\n", vm.size() - 1);
+	printf("variable slots:    %d\n", (int)vm.slotCount());
+	printf("status:            %s\n", status);
+	if (result.status == VM_ERROR) printf("error:             %s at offset %u\n", result.error, result.offset);
+	printf("steps:             %llu\n", (unsigned long long)result.steps);
+	printf("events:            %zu\n", events.size());
+	printf("best run:          %.6f s\n", best);
+	printf("instructions/sec:  %.0f\n", best > 0 ? result.steps / best : 0.0);
+	return 0;
+}
@@ -0,0 +1,192 @@
+// on disk cache of assembled routes, not built into AUTOPILOT_INTERFACE programs
+
+#ifndef AUTOPILOT_INTERFACE
+
+#include "cache.h"
+#include "geofence.h"
+
+#include <atomic>
+#include <random>
+
+namespace fs = std::filesystem;
+
+// entry file: magic, log length, data length, log, data
+static const char CACHE_MAGIC[8] = { 'R', 'A', 'C', 'A', 'C', 'H', 'E', '1' };
+static const size_t CACHE_HEADER = sizeof(CACHE_MAGIC) + 2 * sizeof(uint32_t);
+
+
+// MurmurHash64A, eight bytes at a time
+static uint64_t hash64(std::string_view bytes, uint64_t seed) {
+	const uint64_t m = 0xc6a4a7935bd1e995ULL;
+	const int r = 47;
+	uint64_t h = seed ^ (bytes.size() * m);
+
+	const char* p = bytes.data();
+	const char* end = p + (bytes.size() & ~(size_t)7);
+	for (; p != end; p += 8) {
+		uint64_t k;
+		memcpy(&k, p, 8);
+		k *= m;
+		k ^= k >> r;
+		k *= m;
+		h ^= k;
+		h *= m;
+	}
+
+	switch (bytes.size() & 7) {
+	case 7: h ^= (uint64_t)(uint8_t)p[6] << 48; [[fallthrough]];
+	case 6: h ^= (uint64_t)(uint8_t)p[5] << 40; [[fallthrough]];
+	case 5: h ^= (uint64_t)(uint8_t)p[4] << 32; [[fallthrough]];
+	case 4: h ^= (uint64_t)(uint8_t)p[3] << 24; [[fallthrough]];
+	case 3: h ^= (uint64_t)(uint8_t)p[2] << 16; [[fallthrough]];
+	case 2: h ^= (uint64_t)(uint8_t)p[1] << 8; [[fallthrough]];
+	case 1: h ^= (uint64_t)(uint8_t)p[0];
+		h *= m;
+	}
+
+	h ^= h >> r;
+	h *= m;
+	h ^= h >> r;
+	return h;
+}
+
+
+bool BuildCache::open(std::string directory, uint64_t limit) {
+	std::error_code error;
+	fs::create_directories(directory, error);
+	if (error || !fs::is_directory(directory, error)) return false;
+	this->directory = directory;
+	this->limit = limit;
+	return true;
+}
+
+
+std::string BuildCache::key(std::string_view inputpath, std::string_view source, const AssemblerOptions& options) {
+	// everything but the source and fence is small, so it is hashed as one string
+	char settings[160];
+	uint64_t fence = 0;
+	if (options.geofence) {
+		const Geofence& geofence = *options.geofence;
+		auto& edges = geofence.edges();
+		fence = hash64(std::string_view((const char*)edges.data(), edges.size() * sizeof(FenceEdge)), 0);
+		fence ^= hash64(std::string_view((const char*)&geofence.floor, sizeof(double)), fence);
+		fence ^= hash64(std::string_view((const char*)&geofence.ceiling, sizeof(double)), fence);
+	}
+	snprintf(settings, sizeof(settings), "%s|%d|%d|%d|%a|%d|%d|%a|%d|%016llx|%d|%d|%d|", ROUTEASM_VERSION,
+		(int)options.jumpOffsets, (int)options.optimize, (int)options.unrollLimit, (double)options.pointResolution,
+		(int)options.llaToNed, (int)options.legTable, (double)options.simplifyTolerance,
+		options.geofence != nullptr, (unsigned long long)fence, (int)options.fenceWarnings, (int)options.stepBudget,
+		(int)options.reuseSlots);
+	std::string header = std::string(settings).append(inputpath);
+
+	// two seeds make a 128 bit key
+	uint64_t parts[2];
+	for (INT_T i = 0; i < 2; ++i) {
+		uint64_t seed = hash64(header, 0x9e3779b97f4a7c15ULL * (i + 1));
+		parts[i] = hash64(source, seed);
+	}
+
+	char key[33];
+	snprintf(key, sizeof(key), "%016llx%016llx", (unsigned long long)parts[0], (unsigned long long)parts[1]);
+	return key;
+}
+
+
+bool BuildCache::lookup(const std::string& key, std::vector<uint8_t>& data, std::string& log) {
+	fs::path path = directory / (key + ".rac");
+	MappedFile entry;
+	if (!entry.open(path.string())) return false;
+
+	std::string_view bytes = entry.view();
+	if (bytes.size() < CACHE_HEADER || memcmp(bytes.data(), CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0) return false;
+	uint32_t loglength, datalength;
+	memcpy(&loglength, bytes.data() + sizeof(CACHE_MAGIC), sizeof(uint32_t));
+	memcpy(&datalength, bytes.data() + sizeof(CACHE_MAGIC) + sizeof(uint32_t), sizeof(uint32_t));
+	if (bytes.size() != CACHE_HEADER + (uint64_t)loglength + datalength) return false;
+
+	const char* body = bytes.data() + CACHE_HEADER;
+	log.assign(body, loglength);
+	data.assign(body + loglength, body + loglength + datalength);
+
+	// used entries are the last to be trimmed
+	std::error_code error;
+	fs::last_write_time(path, fs::file_time_type::clock::now(), error);
+	return true;
+}
+
+
+void BuildCache::store(const std::string& key, const std::vector<uint8_t>& data, const std::string& log) {
+	// unique across processes and threads sharing the directory
+	static std::atomic<uint64_t> counter{ 0 };
+	static const uint64_t process = ((uint64_t)std::random_device{}() << 32) ^ std::random_device{}();
+	char name[64];
+	snprintf(name, sizeof(name), "%016llx-%llu.tmp", (unsigned long long)process, (unsigned long long)counter++);
+	fs::path temporary = directory / name;
+
+	uint32_t loglength = log.size();
+	uint32_t datalength = data.size();
+	{
+		std::ofstream f(temporary, std::ofstream::binary | std::ofstream::trunc);
+		f.write(CACHE_MAGIC, sizeof(CACHE_MAGIC));
+		f.write((const char*)&loglength, sizeof(loglength));
+		f.write((const char*)&datalength, sizeof(datalength));
+		f.write(log.data(), log.size());
+		f.write((const char*)data.data(), data.size());
+		f.close();
+		if (f.fail()) {
+			std::error_code error;
+			fs::remove(temporary, error);
+			return;
+		}
+	}
+
+	// rename replaces an entry another process stored meanwhile,
+	// which holds the same bytes
+	std::error_code error;
+	fs::rename(temporary, directory / (key + ".rac"), error);
+	if (error) fs::remove(temporary, error);
+}
+
+
+void BuildCache::trim() {
+	struct Entry {
+		fs::file_time_type time;
+		uint64_t size;
+		fs::path path;
+	};
+	std::vector<Entry> entries;
+	uint64_t total = 0;
+	auto now = fs::file_time_type::clock::now();
+
+	std::error_code error;
+	for (fs::directory_iterator it(directory, error), end; !error && it != end; it.increment(error)) {
+		std::error_code status;
+		if (!it->is_regular_file(status)) continue;
+		fs::file_time_type time = it->last_write_time(status);
+		if (status) continue;
+		fs::path path = it->path();
+		if (path.extension() == ".tmp") {
+			// left behind by a process that died while storing
+			if (now - time > std::chrono::hours(1)) fs::remove(path, status);
+			continue;
+		}
+		if (path.extension() != ".rac") continue;
+		uint64_t size = it->file_size(status);
+		if (status) continue;
+		entries.push_back({ time, size, path });
+		total += size;
+	}
+	if (total <= limit) return;
+
+	// trim below the limit so the next few runs do not trim again
+	uint64_t target = limit - limit / 8;
+	std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.time < b.time; });
+	for (auto& entry : entries) {
+		if (total <= target) break;
+		// another process may have trimmed it already, gone either way
+		fs::remove(entry.path, error);
+		total -= entry.size;
+	}
+}
+
+#endif
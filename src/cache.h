@@ -0,0 +1,37 @@
+// on disk cache of assembled routes
+
+#ifndef CACHE_H
+#define CACHE_H
+
+#include "routeasm.h"
+
+// Content addressed store of assembler output. Entries are keyed
+// on a hash of the source bytes, the input path (it appears in
+// messages), ROUTEASM_VERSION and the options, so a hit gives the
+// exact data and log a fresh assembly would.
+//
+// Every entry is written to a temporary file and renamed into
+// place, so processes sharing a directory only ever see whole
+// entries. A hit refreshes the entry's modification time and
+// trim() deletes the least recently used entries until the
+// directory fits its size limit.
+class BuildCache {
+public:
+	// limit is the size trim() keeps the directory to, in bytes
+	bool open(std::string directory, uint64_t limit);
+
+	static std::string key(std::string_view inputpath, std::string_view source, const AssemblerOptions& options);
+
+	// false on a miss or an unreadable entry
+	bool lookup(const std::string& key, std::vector<uint8_t>& data, std::string& log);
+	// best effort, a failed store only costs a later miss
+	void store(const std::string& key, const std::vector<uint8_t>& data, const std::string& log);
+	// delete least recently used entries down to the limit
+	void trim();
+
+private:
+	std::filesystem::path directory;
+	uint64_t limit = 0;
+};
+
+#endif
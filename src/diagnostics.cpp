@@ -0,0 +1,217 @@
+#include "diagnostics.h"
+#include "mnemonic.h"
+
+
+// upper case mnemonic name for messages
+static std::string displayName(std::string_view name) {
+	std::string upper(name);
+	transform(upper.begin(), upper.end(), upper.begin(), ::toupper);
+	return upper;
+}
+
+
+static std::string opcodeName(int32_t opcode) {
+	return displayName(findOpcode((uint8_t)opcode)->name);
+}
+
+
+void Diagnostics::clear() {
+	records.clear();
+	quotes.clear();
+	errorCount = 0;
+	warningCount = 0;
+	files.clear();
+	file = 0;
+}
+
+
+void Diagnostics::report(DiagnosticCode code, INT_T line, INT_T column, std::string_view quote,
+	int32_t value0, int32_t value1, int32_t value2) {
+	Severity level = severity(code);
+	if (level == SEVERITY_ERROR) ++errorCount;
+	else ++warningCount;
+	if (records.size() == MAX_RECORDS) return;
+	if (records.capacity() == 0) {
+		records.reserve(MAX_RECORDS);
+		quotes.reserve(MAX_RECORDS * MAX_QUOTE);
+	}
+
+	Diagnostic diagnostic;
+	diagnostic.severity = level;
+	diagnostic.code = code;
+	diagnostic.file = file;
+	diagnostic.quoteStart = quotes.size();
+	diagnostic.quoteLength = (uint8_t)MIN_2(quote.size(), MAX_QUOTE);
+	diagnostic.line = (int32_t)line;
+	diagnostic.column = (int32_t)column;
+	diagnostic.span = (int32_t)quote.size();
+	diagnostic.values[0] = value0;
+	diagnostic.values[1] = value1;
+	diagnostic.values[2] = value2;
+	quotes.append(quote.substr(0, diagnostic.quoteLength));
+	records.push_back(diagnostic);
+}
+
+
+void Diagnostics::format(const Diagnostic& diagnostic, std::string& out) const {
+	out.append(diagnostic.file ? files[diagnostic.file - 1] : path);
+	char position[32];
+	if (diagnostic.line > -1 && diagnostic.column > -1) snprintf(position, sizeof(position), "(%d,%d): ", (int)diagnostic.line, (int)diagnostic.column);
+	else if (diagnostic.line > -1) snprintf(position, sizeof(position), "(%d): ", (int)diagnostic.line);
+	else snprintf(position, sizeof(position), ": ");
+	out.append(position);
+
+	std::string_view text = quote(diagnostic);
+	const int32_t* values = diagnostic.values;
+	char number[16];
+	switch (diagnostic.code) {
+	case DIAG_UNKNOWN_COMMAND:
+		out.append("Error: Unknown command");
+		break;
+
+	case DIAG_MISSING_OPERANDS:
+		out.append("Error: ").append(displayName(text)).append(" requires ");
+		snprintf(number, sizeof(number), "%d", (int)values[0]);
+		out.append(number).append(" arguments, ");
+		snprintf(number, sizeof(number), "%d", (int)values[1]);
+		out.append(number).append(" given");
+		break;
+
+	case DIAG_INVALID_NUMBER:
+	case DIAG_NUMBER_RANGE: {
+		const char* kind = values[0] == NUMBER_INTEGER ? "integer" : values[0] == NUMBER_FLOAT ? "number" : "step count";
+		if (diagnostic.code == DIAG_NUMBER_RANGE) out.append("Error: ").append(kind).append(" \"").append(text).append("\" out of range");
+		else out.append("Error: invalid ").append(kind).append(" \"").append(text).append("\"");
+		break;
+	}
+
+	case DIAG_UNDEFINED_VARIABLE:
+		out.append("Error: reference to undefined variable \"").append(text).append("\"");
+		break;
+
+	case DIAG_TOO_MANY_VARIABLES:
+		snprintf(number, sizeof(number), "%d", (int)SymbolTable::MAX_SYMBOLS);
+		out.append("Error: too many variables, \"").append(text).append("\" exceeds the limit of ").append(number);
+		break;
+
+	case DIAG_UNMATCHED_END:
+		out.append("Error: ").append(opcodeName(values[0])).append(" without a matching block start");
+		break;
+
+	case DIAG_MISMATCHED_END:
+		snprintf(number, sizeof(number), "%d", (int)values[2]);
+		out.append("Error: ").append(opcodeName(values[0])).append(" cannot close ").append(opcodeName(values[1]))
+			.append(" on line ").append(number);
+		break;
+
+	case DIAG_BREAK_OUTSIDE_WHILE:
+		out.append("Error: BREAK_WHILE outside a while loop");
+		break;
+
+	case DIAG_BREAK_TOO_DEEP:
+		out.append("Error: BREAK_WHILE leaves too many FOR loops");
+		break;
+
+	case DIAG_NO_END:
+		out.append("Error: no \"END\" mnemonic found");
+		break;
+
+	case DIAG_UNCLOSED_BLOCK:
+		out.append("Error: ").append(opcodeName(values[0])).append(" is never closed");
+		break;
+
+	case DIAG_UNREACHABLE:
+		out.append("Warning: unreachable code after \"END\" mnemonic");
+		break;
+
+	case DIAG_UNKNOWN_DIRECTIVE:
+		out.append("Error: Unknown directive");
+		break;
+
+	case DIAG_NESTED_FRAGMENT:
+		out.append("Error: .FRAGMENT inside a block or another fragment");
+		break;
+
+	case DIAG_UNMATCHED_ENDFRAGMENT:
+		out.append("Error: .ENDFRAGMENT without a matching .FRAGMENT");
+		break;
+
+	case DIAG_UNCLOSED_FRAGMENT:
+		out.append("Error: fragment \"").append(text).append("\" is never closed");
+		break;
+
+	case DIAG_UNDEFINED_SYMBOL:
+		out.append("Error: \"").append(text).append("\" is not defined by any module");
+		break;
+
+	case DIAG_DUPLICATE_SYMBOL:
+		out.append("Error: \"").append(text).append("\" is defined more than once");
+		break;
+
+	case DIAG_RECURSIVE_FRAGMENT:
+		out.append("Error: fragment \"").append(text).append("\" uses itself");
+		break;
+
+	case DIAG_NO_MAIN:
+		out.append("Error: no module has code outside fragments");
+		break;
+
+	case DIAG_MULTIPLE_MAIN:
+		out.append("Error: code outside fragments is also in another module");
+		break;
+
+	case DIAG_NO_HOME:
+		out.append("Error: home position not defined, use .home_ll to define");
+		break;
+
+	case DIAG_DUPLICATE_HOME:
+		out.append("Error: home position defined more than once");
+		break;
+
+	case DIAG_OUTSIDE_FENCE: {
+		static const char* const breaches[] = { "inside", "outside the geofence", "inside a geofence exclusion area",
+			"below the geofence floor", "above the geofence ceiling" };
+		out.append(diagnostic.severity == SEVERITY_ERROR ? "Error: " : "Warning: ").append("waypoint ").append(breaches[values[0]]);
+		break;
+	}
+
+	case DIAG_LEAVES_FENCE:
+		out.append(diagnostic.severity == SEVERITY_ERROR ? "Error: " : "Warning: ").append("leg from line ");
+		snprintf(number, sizeof(number), "%d", (int)values[0]);
+		out.append(number).append(" crosses the geofence edge on fence line ");
+		snprintf(number, sizeof(number), "%d", (int)values[1]);
+		out.append(number);
+		break;
+
+	case DIAG_STEP_BUDGET: {
+		std::string from = "the start";
+		if (values[1] >= 0) from = "line " + std::to_string(values[1]);
+		else if (values[1] == -2) from = "an event in another file";
+		if (values[0] < 0) out.append("Error: loop can run without end after ").append(from);
+		else {
+			snprintf(number, sizeof(number), "%d", (int)values[0]);
+			out.append("Error: ").append(number).append(" instructions can run from ").append(from).append(" to here");
+		}
+		snprintf(number, sizeof(number), "%d", (int)values[2]);
+		out.append(", over the step budget of ").append(number);
+		break;
+	}
+
+	case DIAG_STEPS_UNCOUNTED:
+		out.append("Error: steps could not be counted, blocks do not nest here");
+		break;
+	}
+	out.push_back('\n');
+}
+
+
+void Diagnostics::format(std::string& out) const {
+	for (auto& diagnostic : records) format(diagnostic, out);
+
+	size_t dropped = errorCount + warningCount - records.size();
+	if (dropped > 0) {
+		char buffer[64];
+		snprintf(buffer, sizeof(buffer), ": %zu more errors and warnings not shown\n", dropped);
+		out.append(path).append(buffer);
+	}
+}
@@ -0,0 +1,131 @@
+// errors and warnings found while assembling
+
+#ifndef DIAGNOSTICS_H
+#define DIAGNOSTICS_H
+
+#include "util.h"
+
+enum Severity : uint8_t {
+	SEVERITY_WARNING,
+	SEVERITY_ERROR
+};
+
+// what each code keeps in its quote and values
+enum DiagnosticCode : uint8_t {
+	// quote: the token
+	DIAG_UNKNOWN_COMMAND,
+	// quote: mnemonic, values: operands required, operands given
+	DIAG_MISSING_OPERANDS,
+	// quote: the operand, values: NumberKind
+	DIAG_INVALID_NUMBER,
+	DIAG_NUMBER_RANGE,
+	// quote: the name
+	DIAG_UNDEFINED_VARIABLE,
+	DIAG_TOO_MANY_VARIABLES,
+	// values: opcode
+	DIAG_UNMATCHED_END,
+	// values: opcode, opcode of the open block, line of the open block
+	DIAG_MISMATCHED_END,
+	DIAG_BREAK_OUTSIDE_WHILE,
+	DIAG_BREAK_TOO_DEEP,
+	DIAG_NO_END,
+	// values: opcode
+	DIAG_UNCLOSED_BLOCK,
+	DIAG_UNREACHABLE,
+	// quote: the directive
+	DIAG_UNKNOWN_DIRECTIVE,
+	DIAG_NESTED_FRAGMENT,
+	DIAG_UNMATCHED_ENDFRAGMENT,
+	// quote: the name
+	DIAG_UNCLOSED_FRAGMENT,
+	DIAG_UNDEFINED_SYMBOL,
+	DIAG_DUPLICATE_SYMBOL,
+	DIAG_RECURSIVE_FRAGMENT,
+	DIAG_NO_MAIN,
+	DIAG_MULTIPLE_MAIN,
+	DIAG_NO_HOME,
+	DIAG_DUPLICATE_HOME,
+	// values: FenceBreach
+	DIAG_OUTSIDE_FENCE,
+	// values: line of the waypoint the leg starts at, fence line of
+	// the edge it crosses
+	DIAG_LEAVES_FENCE,
+	// values: instructions, -1 for a loop that may not end, line the
+	// stretch starts after, -1 for the start and -2 for a line in
+	// another file, the budget
+	DIAG_STEP_BUDGET,
+	// blocks a pass left that do not nest, so steps were not counted
+	DIAG_STEPS_UNCOUNTED
+};
+
+enum NumberKind : int32_t {
+	NUMBER_INTEGER,
+	NUMBER_FLOAT,
+	NUMBER_STEPS
+};
+
+struct Diagnostic {
+	Severity severity;
+	DiagnosticCode code;
+	// quoted source text, held by Diagnostics
+	uint8_t quoteLength;
+	uint32_t quoteStart;
+	// 0 for Diagnostics::path, otherwise one more than an index into files
+	uint16_t file;
+	// one based, line -1 is the whole file and column -1 the whole line
+	int32_t line;
+	int32_t column;
+	// length of the source text the diagnostic is about
+	int32_t span;
+	int32_t values[3];
+};
+
+// Records diagnostics as they are found and formats them only
+// when asked. Storage is reserved at the first report, after
+// which reporting never allocates. Past MAX_RECORDS diagnostics
+// are counted but not kept.
+class Diagnostics {
+public:
+	static constexpr size_t MAX_RECORDS = 1024;
+	// quoted text longer than this is cut short
+	static constexpr size_t MAX_QUOTE = 32;
+
+	void clear();
+	void report(DiagnosticCode code, INT_T line, INT_T column = -1, std::string_view quote = {},
+		int32_t value0 = 0, int32_t value1 = 0, int32_t value2 = 0);
+
+	Severity severity(DiagnosticCode code) const {
+		bool fence = code == DIAG_OUTSIDE_FENCE || code == DIAG_LEAVES_FENCE;
+		return code == DIAG_UNREACHABLE || (fence && fenceWarnings) ? SEVERITY_WARNING : SEVERITY_ERROR;
+	}
+
+	size_t size() const { return records.size(); }
+	const Diagnostic& operator[](size_t i) const { return records[i]; }
+	std::string_view quote(const Diagnostic& diagnostic) const {
+		return std::string_view(quotes).substr(diagnostic.quoteStart, diagnostic.quoteLength);
+	}
+	// counts include diagnostics past MAX_RECORDS
+	size_t errors() const { return errorCount; }
+	size_t warnings() const { return warningCount; }
+
+	// append every diagnostic as "path(line,column): message" lines
+	void format(std::string& out) const;
+	void format(const Diagnostic& diagnostic, std::string& out) const;
+
+	// file named in messages
+	std::string path;
+	// when linking, the modules' files. Reports name files[file - 1]
+	// while file is set, and path while it is 0
+	std::vector<std::string> files;
+	uint16_t file = 0;
+	// geofence breaches are warnings rather than errors
+	bool fenceWarnings = false;
+
+private:
+	std::vector<Diagnostic> records;
+	std::string quotes;
+	size_t errorCount = 0;
+	size_t warningCount = 0;
+};
+
+#endif
@@ -0,0 +1,356 @@
+#include "disasm.h"
+#include "mnemonic.h"
+
+
+// one instruction as encoded
+struct Encoded {
+	const Mnemonic* mnemonic;
+	INT_T size;
+	bool jump;
+	// from the end of the instruction, only if jump
+	int32_t offset;
+	// FOR loops left by BREAK_WHILE, only if jump
+	uint8_t pops;
+};
+
+
+static bool decode(const uint8_t* data, size_t size, size_t at, Encoded& encoded, std::string& error) {
+	char buffer[96];
+	INT_T length = instructionSize(data[at]);
+	if (length < 0) {
+		snprintf(buffer, sizeof(buffer), "invalid opcode 0x%02x at offset %zu", data[at], at);
+		error = buffer;
+		return false;
+	}
+	if ((size_t)length > size - at) {
+		snprintf(buffer, sizeof(buffer), "instruction at offset %zu runs past the end", at);
+		error = buffer;
+		return false;
+	}
+
+	encoded.jump = data[at] & JUMP_FLAG;
+	encoded.mnemonic = findOpcode(data[at] & ~JUMP_FLAG);
+	encoded.size = length;
+	if (encoded.jump) {
+		const uint8_t* field = data + at + encoded.mnemonic->size;
+		encoded.offset = (int32_t)((uint32_t)field[0] | (uint32_t)field[1] << 8 | (uint32_t)field[2] << 16 | (uint32_t)field[3] << 24);
+		encoded.pops = encoded.mnemonic->opcode == BREAK_WHILE ? field[4] : 0;
+	}
+	return true;
+}
+
+
+// append the mnemonic and operands of an instruction as source
+static void formatInstruction(const uint8_t* bytes, const Mnemonic* mnemonic, std::string& out) {
+	std::string name(mnemonic->name);
+	transform(name.begin(), name.end(), name.begin(), ::toupper);
+	out.append(name);
+
+	char buffer[32];
+	const uint8_t* operand = bytes + 1;
+	for (INT_T i = 0; i < mnemonic->count; ++i) {
+		uint8_t type = mnemonic->operands[i];
+		switch (type) {
+		case OPERAND_VAR:
+		case OPERAND_DECL:
+			snprintf(buffer, sizeof(buffer), " v%d", (int)operand[0]);
+			break;
+		case OPERAND_INT:
+			snprintf(buffer, sizeof(buffer), " %d", (int)(int16_t)(operand[0] | operand[1] << 8));
+			break;
+		case OPERAND_FLOAT: {
+			float value;
+			memcpy(&value, operand, 4);
+			// enough digits to give the same float back
+			snprintf(buffer, sizeof(buffer), " %.9g", value);
+			break;
+		}
+		case OPERAND_Q8:
+		case OPERAND_Q16:
+		case OPERAND_Q24: {
+			INT_T length = operandSize(type);
+			uint32_t raw = 0;
+			for (INT_T j = 0; j < length; ++j) raw |= (uint32_t)operand[j] << (8 * j);
+			// sign extend from the top byte
+			int32_t value = (int32_t)(raw << (32 - 8 * length)) >> (32 - 8 * length);
+			snprintf(buffer, sizeof(buffer), " %d", (int)value);
+			break;
+		}
+		}
+		out.append(buffer);
+		operand += operandSize(type);
+	}
+}
+
+
+// check the LEG_TABLE at data[at] runs whole to the end
+static bool checkLegTable(const uint8_t* data, size_t size, size_t at, std::string& error) {
+	if (validLegTable(data, size, at)) return true;
+	char buffer[64];
+	snprintf(buffer, sizeof(buffer), "damaged leg table at offset %zu", at);
+	error = buffer;
+	return false;
+}
+
+
+static float readFloat(const uint8_t* bytes) {
+	float value;
+	memcpy(&value, bytes, 4);
+	return value;
+}
+
+
+static uint32_t readWord(const uint8_t* bytes) {
+	return (uint32_t)bytes[0] | (uint32_t)bytes[1] << 8 | (uint32_t)bytes[2] << 16 | (uint32_t)bytes[3] << 24;
+}
+
+
+// skip the SLOT_COUNT data starts with, if any, returning the
+// offset of the first instruction or -1 with error set
+static INT_T skipSlotCount(const uint8_t* data, size_t size, INT_T& slots, std::string& error) {
+	INT_T header = readSlotCount(data, size, slots);
+	if (header < 0) error = "damaged slot count at offset 0";
+	return header;
+}
+
+
+// list a leg table as comments, one leg per line
+static void formatLegs(const uint8_t* data, size_t size, size_t at, std::string& out) {
+	uint32_t count = readWord(data + at + 1);
+	double total = 0;
+	for (size_t record = at + 5; record < size; record += LEG_SIZE) total += readFloat(data + record + 8);
+	char buffer[128];
+	snprintf(buffer, sizeof(buffer), "; %08zx: leg table, %u legs, %.3f m\n", at, (unsigned)count, total);
+	out.append(buffer);
+	for (size_t record = at + 5; record < size; record += LEG_SIZE) {
+		snprintf(buffer, sizeof(buffer), ";   %08x -> %08x %12.3f m  heading %8.3f  turn %8.3f\n", (unsigned)readWord(data + record),
+			(unsigned)readWord(data + record + 4), readFloat(data + record + 8), readFloat(data + record + 12), readFloat(data + record + 16));
+		out.append(buffer);
+	}
+}
+
+
+bool disassemble(const uint8_t* data, size_t size, std::ostream& out, std::string& error) {
+	// column the comments start at
+	const size_t COMMENT = 40;
+	std::string text;
+	char buffer[64];
+	INT_T depth = 0;
+
+	INT_T slots;
+	INT_T header = skipSlotCount(data, size, slots, error);
+	if (header < 0) return false;
+	if (header > 0) {
+		snprintf(buffer, sizeof(buffer), "; %08x: %d variable slots\n", 0u, (int)slots);
+		text.append(buffer);
+	}
+	for (size_t at = header; at < size;) {
+		if (data[at] == LEG_TABLE) {
+			if (!checkLegTable(data, size, at, error)) {
+				out << text;
+				return false;
+			}
+			formatLegs(data, size, at, text);
+			break;
+		}
+		Encoded encoded;
+		if (!decode(data, size, at, encoded, error)) {
+			out << text;
+			return false;
+		}
+		uint8_t opcode = encoded.mnemonic->opcode;
+
+		if (opcode == ENDWHILE || opcode == ENDFOR || opcode == ENDIF) depth = MAX_2(depth - 1, (INT_T)0);
+		size_t start = text.size();
+		text.append(2 * depth, ' ');
+		formatInstruction(data + at, encoded.mnemonic, text);
+		if (opcode == WHILE || opcode == WHILE_VAR || opcode == FOR || opcode == FOR_VAR || (opcode >= IF_Z && opcode <= IF_NEG)) ++depth;
+
+		size_t width = text.size() - start;
+		text.append(width < COMMENT ? COMMENT - width : 1, ' ');
+		snprintf(buffer, sizeof(buffer), "; %08zx:", at);
+		text.append(buffer);
+		for (INT_T i = 0; i < encoded.size; ++i) {
+			snprintf(buffer, sizeof(buffer), " %02x", data[at + i]);
+			text.append(buffer);
+		}
+		if (encoded.jump) {
+			snprintf(buffer, sizeof(buffer), " -> %08llx", (unsigned long long)((int64_t)(at + encoded.size) + encoded.offset));
+			text.append(buffer);
+			if (opcode == BREAK_WHILE) {
+				snprintf(buffer, sizeof(buffer), ", leaves %d FOR", (int)encoded.pops);
+				text.append(buffer);
+			}
+		}
+		text.push_back('\n');
+
+		if (text.size() > 1 << 16) {
+			out << text;
+			text.clear();
+		}
+		at += encoded.size;
+	}
+	out << text;
+	return true;
+}
+
+
+bool sizeReport(const uint8_t* data, size_t size, SizeReport& report, std::string& error) {
+	INT_T slots;
+	INT_T header = skipSlotCount(data, size, slots, error);
+	if (header < 0) return false;
+	if (header > 0) {
+		++report.count[SLOT_COUNT];
+		report.bytes[SLOT_COUNT] += header;
+		report.total += header;
+	}
+	for (size_t at = header; at < size;) {
+		if (data[at] == LEG_TABLE) {
+			if (!checkLegTable(data, size, at, error)) return false;
+			++report.count[LEG_TABLE];
+			report.bytes[LEG_TABLE] += size - at;
+			report.total += size - at;
+			break;
+		}
+		Encoded encoded;
+		if (!decode(data, size, at, encoded, error)) return false;
+		uint8_t opcode = encoded.mnemonic->opcode;
+		++report.count[opcode];
+		report.bytes[opcode] += encoded.size;
+		if (encoded.jump) report.jumpBytes += encoded.size - encoded.mnemonic->size;
+		report.total += encoded.size;
+		at += encoded.size;
+	}
+	return true;
+}
+
+
+bool stepReport(const uint8_t* data, size_t size, StepReport& report, std::string& error) {
+	std::vector<RouteOp> code;
+	report.offsets.clear();
+	INT_T slots;
+	INT_T header = skipSlotCount(data, size, slots, error);
+	if (header < 0) return false;
+	for (size_t at = header; at < size;) {
+		if (data[at] == LEG_TABLE) {
+			if (!checkLegTable(data, size, at, error)) return false;
+			break;
+		}
+		Encoded encoded;
+		if (!decode(data, size, at, encoded, error)) return false;
+		// decodeOp takes the opcode without JUMP_FLAG
+		uint8_t bytes[16];
+		memcpy(bytes, data + at, encoded.mnemonic->size);
+		bytes[0] = encoded.mnemonic->opcode;
+		RouteOp op = {};
+		decodeOp(bytes, op);
+		code.push_back(op);
+		report.offsets.push_back((uint32_t)at);
+		at += encoded.size;
+	}
+
+	INT_T at;
+	if (!analyzeSteps(code, report, at)) {
+		char buffer[96];
+		snprintf(buffer, sizeof(buffer), "block structure broken at offset %u", (unsigned)report.offsets[at]);
+		error = buffer;
+		return false;
+	}
+	return true;
+}
+
+
+// source construct an opcode belongs to
+static const char* construct(uint8_t opcode) {
+	switch (opcode) {
+	case POINT:
+	case POINT_LLA:
+	case POINT_RESOLUTION:
+	case POINT_Q24:
+	case POINT_D16:
+	case POINT_D8:
+		return "waypoints";
+	case WHILE:
+	case WHILE_VAR:
+	case ENDWHILE:
+	case BREAK_WHILE:
+	case FOR:
+	case FOR_VAR:
+	case ENDFOR:
+		return "loops";
+	case IF_Z:
+	case IF_NZ:
+	case IF_POS:
+	case IF_NEG:
+	case ENDIF:
+		return "conditions";
+	case INTEGER:
+	case SLOT_COUNT:
+		return "declarations";
+	case LAUNCH:
+	case LAND:
+	case RTL:
+		return "flight modes";
+	case PRINT:
+		return "printing";
+	case END:
+		return "end";
+	case LEG_TABLE:
+		return "leg table";
+	default:
+		return "arithmetic";
+	}
+}
+
+
+void SizeReport::format(std::string& out) const {
+	char buffer[128];
+	auto percent = [&](uint64_t bytes) { return total ? 100.0 * bytes / total : 0.0; };
+
+	// largest first
+	std::vector<INT_T> opcodes;
+	for (INT_T opcode = 0; opcode < 256; ++opcode) {
+		if (count[opcode]) opcodes.push_back(opcode);
+	}
+	std::stable_sort(opcodes.begin(), opcodes.end(), [&](INT_T a, INT_T b) { return bytes[a] > bytes[b]; });
+
+	out.append("opcode                 count        bytes      %\n");
+	for (INT_T opcode : opcodes) {
+		std::string name(opcode == LEG_TABLE ? "leg_table" : opcode == SLOT_COUNT ? "slot_count" : findOpcode((uint8_t)opcode)->name);
+		transform(name.begin(), name.end(), name.begin(), ::toupper);
+		snprintf(buffer, sizeof(buffer), "%-18s %9llu %12llu %6.2f\n", name.c_str(), (unsigned long long)count[opcode],
+			(unsigned long long)bytes[opcode], percent(bytes[opcode]));
+		out.append(buffer);
+	}
+
+	// constructs in order of first appearance in the opcode list,
+	// with jump offsets split out of loops and conditions
+	std::vector<std::pair<const char*, uint64_t>> constructs;
+	for (INT_T opcode : opcodes) {
+		const char* name = construct((uint8_t)opcode);
+		size_t i = 0;
+		while (i < constructs.size() && strcmp(constructs[i].first, name) != 0) ++i;
+		if (i == constructs.size()) constructs.push_back({ name, 0 });
+		constructs[i].second += bytes[opcode];
+	}
+	if (jumpBytes) {
+		for (auto& entry : constructs) {
+			if (strcmp(entry.first, "loops") && strcmp(entry.first, "conditions")) continue;
+			uint64_t jumps = 0;
+			for (INT_T opcode : opcodes) {
+				if (strcmp(construct((uint8_t)opcode), entry.first) == 0) jumps += bytes[opcode] - count[opcode] * findOpcode((uint8_t)opcode)->size;
+			}
+			entry.second -= jumps;
+		}
+		constructs.push_back({ "jump offsets", jumpBytes });
+	}
+	std::stable_sort(constructs.begin(), constructs.end(), [](auto& a, auto& b) { return a.second > b.second; });
+
+	out.append("\nconstruct                           bytes      %\n");
+	for (auto& entry : constructs) {
+		snprintf(buffer, sizeof(buffer), "%-28s %12llu %6.2f\n", entry.first, (unsigned long long)entry.second, percent(entry.second));
+		out.append(buffer);
+	}
+	snprintf(buffer, sizeof(buffer), "%-28s %12llu\n", "total", (unsigned long long)total);
+	out.append(buffer);
+}
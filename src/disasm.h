@@ -0,0 +1,38 @@
+// reading assembled routes back
+
+#ifndef DISASM_H
+#define DISASM_H
+
+#include "routeasm.h"
+#include "steps.h"
+
+// Write data as route source, one instruction per line indented
+// by block depth, with its offset, bytes and any jump target in a
+// comment. Variables are named by slot, v0 upwards, so the listing
+// assembles again. A SLOT_COUNT or LEG_TABLE is listed in comments,
+// assembling with reuseSlots or legTable writes it again. Output
+// is written in pieces so large programs are never held as text.
+// Returns false, with error set, at the first byte that does not
+// start a whole instruction.
+bool disassemble(const uint8_t* data, size_t size, std::ostream& out, std::string& error);
+
+// bytes used by each opcode, and by each kind of construct
+struct SizeReport {
+	// by opcode without JUMP_FLAG, jump offsets included
+	uint64_t count[256] = {};
+	uint64_t bytes[256] = {};
+	// bytes of jump offsets and BREAK_WHILE loop counts
+	uint64_t jumpBytes = 0;
+	uint64_t total = 0;
+
+	void format(std::string& out) const;
+};
+
+// false with error set as for disassemble()
+bool sizeReport(const uint8_t* data, size_t size, SizeReport& report, std::string& error);
+
+// analyzeSteps() over the instructions in data, with their offsets.
+// False with error set as for disassemble(), or if blocks do not nest
+bool stepReport(const uint8_t* data, size_t size, StepReport& report, std::string& error);
+
+#endif
@@ -0,0 +1,126 @@
+#include "geodesy.h"
+
+// WGS84 semi-major axis and first eccentricity squared
+static constexpr double WGS84_A = 6378137.0;
+static constexpr double WGS84_F = 1 / 298.257223563;
+static constexpr double WGS84_E2 = WGS84_F * (2 - WGS84_F);
+
+static constexpr double PI = 3.14159265358979323846;
+static constexpr double DEGREES = 0.017453292519943295769;
+static constexpr double TWO_OVER_PI = 0.63661977236758134308;
+// pi / 2 in two parts, the first exact when multiplied by a small integer
+static constexpr double PIO2_HIGH = 1.57079632673412561417e+00;
+static constexpr double PIO2_LOW = 6.07710050650619224932e-11;
+
+
+// Sine and cosine of x radians, for |x| up to a few pi. Reduced to
+// [-pi/4, pi/4] by quarter turns and finished with the fdlibm kernel
+// polynomials. The quadrant is applied with bit masks, not branches
+static inline void sinCos(double x, double& sine, double& cosine) {
+	// round to nearest, the low bits of shifted then hold the turns
+	double shifted = x * TWO_OVER_PI + 0x1.8p52;
+	double turns = shifted - 0x1.8p52;
+	uint64_t quadrant;
+	memcpy(&quadrant, &shifted, 8);
+	double r = (x - turns * PIO2_HIGH) - turns * PIO2_LOW;
+
+	double z = r * r;
+	double s = r + r * z * (-1.66666666666666324348e-01 + z * (8.33333333332248946124e-03 + z * (-1.98412698298579493134e-04 +
+		z * (2.75573137070700676789e-06 + z * (-2.50507602534068634195e-08 + z * 1.58969099521155010221e-10)))));
+	double c = 1 - 0.5 * z + z * z * (4.16666666666666019037e-02 + z * (-1.38888888888741095749e-03 + z * (2.48015872894767294178e-05 +
+		z * (-2.75573143513906633035e-07 + z * (2.08757232129817482790e-09 + z * -1.13596475577881948265e-11)))));
+
+	// quadrant 1: (c, -s), 2: (-s, -c), 3: (-c, s)
+	uint64_t sBits, cBits;
+	memcpy(&sBits, &s, 8);
+	memcpy(&cBits, &c, 8);
+	uint64_t swap = 0 - (quadrant & 1);
+	uint64_t sineBits = ((sBits & ~swap) | (cBits & swap)) ^ ((quadrant & 2) << 62);
+	uint64_t cosineBits = ((cBits & ~swap) | (sBits & swap)) ^ (((quadrant + 1) & 2) << 62);
+	memcpy(&sine, &sineBits, 8);
+	memcpy(&cosine, &cosineBits, 8);
+}
+
+
+// Angle of (x, y) in radians as atan2. Reduced to [0, tan(pi/8)] by
+// octant and finished with the fdlibm atan polynomial. Comparisons
+// are used as 0 or 1 multipliers so nothing is a branch
+static inline double angle(double y, double x) {
+	double ax = std::fabs(x), ay = std::fabs(y);
+	double swap = ay > ax;
+	double big = ax + swap * (ay - ax), small = ay + swap * (ax - ay);
+	double a = small / (big + (big == 0));
+	// atan(a) = pi / 4 + atan((a - 1) / (a + 1))
+	double reduce = a > 0.41421356237309504880;
+	double t = a + reduce * ((a - 1) / (a + 1) - a);
+
+	double z = t * t, w = z * z;
+	double s1 = z * (3.33333333333329318027e-01 + w * (1.42857142725034663711e-01 + w * (9.09088713343650656196e-02 +
+		w * (6.66107313738753120669e-02 + w * (4.97687799461593236017e-02 + w * 1.62858201153657823623e-02)))));
+	double s2 = w * (-1.99999999998764832476e-01 + w * (-1.11111104054623557880e-01 + w * (-7.69187620504482999495e-02 +
+		w * (-5.83357013379057348645e-02 + w * -3.65315727442169155270e-02))));
+	double r = reduce * (PI / 4) + (t - t * (s1 + s2));
+
+	r += swap * (PI / 2 - 2 * r);
+	r += (x < 0) * (PI - 2 * r);
+	return std::copysign(r, y);
+}
+
+
+INT_T invalidCoordinate(const GeoPoint& point) {
+	// written so NaN fails too
+	if (!(std::fabs(point.latitude) <= 90)) return 0;
+	if (!(std::fabs(point.longitude) <= 180)) return 1;
+	if (!std::isfinite(point.altitude)) return 2;
+	return -1;
+}
+
+
+NedFrame nedFrame(const GeoPoint& home) {
+	NedFrame frame;
+	sinCos(home.latitude * DEGREES, frame.sinLatitude, frame.cosLatitude);
+	sinCos(home.longitude * DEGREES, frame.sinLongitude, frame.cosLongitude);
+	double n = WGS84_A / std::sqrt(1 - WGS84_E2 * frame.sinLatitude * frame.sinLatitude);
+	frame.x = (n + home.altitude) * frame.cosLatitude * frame.cosLongitude;
+	frame.y = (n + home.altitude) * frame.cosLatitude * frame.sinLongitude;
+	frame.z = (n * (1 - WGS84_E2) + home.altitude) * frame.sinLatitude;
+	frame.altitude = home.altitude;
+	return frame;
+}
+
+
+void llaToNed(const NedFrame& frame, const double* __restrict latitude, const double* __restrict longitude,
+	const double* __restrict altitude, size_t count, double* __restrict north, double* __restrict east, double* __restrict down) {
+	const NedFrame f = frame;
+	for (size_t i = 0; i < count; ++i) {
+		double sinLatitude, cosLatitude, sinLongitude, cosLongitude;
+		sinCos(latitude[i] * DEGREES, sinLatitude, cosLatitude);
+		sinCos(longitude[i] * DEGREES, sinLongitude, cosLongitude);
+		double h = f.altitude + altitude[i];
+		// prime vertical radius of curvature
+		double n = WGS84_A / std::sqrt(1 - WGS84_E2 * sinLatitude * sinLatitude);
+
+		double dx = (n + h) * cosLatitude * cosLongitude - f.x;
+		double dy = (n + h) * cosLatitude * sinLongitude - f.y;
+		double dz = (n * (1 - WGS84_E2) + h) * sinLatitude - f.z;
+
+		// rotate into the frame at home
+		double t = f.cosLongitude * dx + f.sinLongitude * dy;
+		north[i] = -f.sinLatitude * t + f.cosLatitude * dz;
+		east[i] = -f.sinLongitude * dx + f.cosLongitude * dy;
+		down[i] = -f.cosLatitude * t - f.sinLatitude * dz;
+	}
+}
+
+
+void legGeometry(const double* __restrict north, const double* __restrict east, const double* __restrict down, size_t count,
+	double* __restrict length, double* __restrict heading) {
+	for (size_t i = 0; i < count; ++i) {
+		length[i] = std::sqrt(north[i] * north[i] + east[i] * east[i] + down[i] * down[i]);
+		double degrees = angle(east[i], north[i]) / DEGREES;
+		// adding 0 also turns -0 into 0, and a tiny negative angle
+		// rounds up to 360 so is wrapped back to 0
+		degrees += (degrees < 0) * 360.0;
+		heading[i] = degrees - (degrees >= 360.0) * 360.0;
+	}
+}
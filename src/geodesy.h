@@ -0,0 +1,46 @@
+// waypoint geometry worked out at assemble time
+
+#ifndef GEODESY_H
+#define GEODESY_H
+
+#include "util.h"
+
+struct GeoPoint {
+	// degrees
+	double latitude;
+	double longitude;
+	// metres, above the ellipsoid for home and above home for waypoints
+	double altitude;
+};
+
+// north east down frame with its origin at home, worked out once
+// for any number of conversions
+struct NedFrame {
+	double sinLatitude, cosLatitude;
+	double sinLongitude, cosLongitude;
+	// home in earth centred, earth fixed metres
+	double x, y, z;
+	double altitude;
+};
+
+// index of the first coordinate that is not finite or, for latitude
+// and longitude, beyond +-90 and +-180 degrees, -1 if none
+INT_T invalidCoordinate(const GeoPoint& point);
+
+NedFrame nedFrame(const GeoPoint& home);
+
+// Convert count waypoints, given as one array per coordinate, to
+// metres north, east and down of home on the WGS84 ellipsoid. The
+// loop has no branches, sine and cosine included, so the compiler
+// vectorizes it; results are within a few nanometres of libm's.
+void llaToNed(const NedFrame& frame, const double* latitude, const double* longitude, const double* altitude,
+	size_t count, double* north, double* east, double* down);
+
+// Length in metres and heading in degrees clockwise from north, from
+// 0 up to 360, of count legs given as their north, east and down
+// extents. A vertical leg has heading 0. Branch free and vectorized
+// as llaToNed, headings are within a few ulps of atan2's.
+void legGeometry(const double* north, const double* east, const double* down, size_t count,
+	double* length, double* heading);
+
+#endif
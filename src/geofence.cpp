@@ -0,0 +1,339 @@
+#include "geofence.h"
+#include "routeasm.h"
+#include "mnemonic.h"
+#include "lexer.h"
+
+
+static bool fenceError(std::string& error, INT_T line, const char* message) {
+	char position[32];
+	snprintf(position, sizeof(position), "(%d): Error: ", (int)line);
+	error.assign(position).append(message);
+	return false;
+}
+
+
+bool Geofence::parse(std::string_view text, std::string& error) {
+	edgeList.clear();
+	hasInclusion = false;
+	floor = -HUGE_VAL;
+	ceiling = HUGE_VAL;
+
+	// area being read, its vertices and their lines
+	INT_T areaLine = -1;
+	bool exclusion = false;
+	std::vector<double> north, east;
+	std::vector<int32_t> lines;
+	auto closeArea = [&]() {
+		if (areaLine < 0) return true;
+		size_t count = north.size();
+		if (count < 3) return fenceError(error, areaLine, "area needs at least 3 vertices");
+		// twice the signed area, positive when the vertices run from north to east
+		double area = 0;
+		for (size_t i = 0; i < count; ++i) {
+			size_t j = (i + 1) % count;
+			area += north[i] * east[j] - north[j] * east[i];
+		}
+		if (area == 0) return fenceError(error, areaLine, "area encloses nothing");
+		for (size_t i = 0; i < count; ++i) {
+			size_t j = (i + 1) % count;
+			if (north[i] == north[j] && east[i] == east[j]) continue;
+			edgeList.push_back({ { north[i], north[j] }, { east[i], east[j] }, lines[i], (int16_t)exclusion, (int16_t)(area > 0 ? -1 : 1) });
+		}
+		hasInclusion |= !exclusion;
+		north.clear();
+		east.clear();
+		lines.clear();
+		return true;
+	};
+
+	Lexer lexer(text);
+	while (lexer.nextLine()) {
+		std::string_view keyword = lexer.nextToken();
+		if (keyword.empty()) continue;
+		std::string_view tokens[3];
+		INT_T count = 0;
+		while (count < 3 && !(tokens[count] = lexer.nextToken()).empty()) ++count;
+		INT_T line = lexer.line();
+
+		bool area = equalsLower(keyword, "inclusion") || equalsLower(keyword, "exclusion");
+		bool limit = equalsLower(keyword, "floor") || equalsLower(keyword, "ceiling");
+		if (!area && !limit && !equalsLower(keyword, "vertex")) return fenceError(error, line, "unknown fence item");
+		double values[2];
+		INT_T operands = area ? 0 : limit ? 1 : 2;
+		if (count != operands) {
+			char message[64];
+			snprintf(message, sizeof(message), "%.*s takes %d arguments", (int)MIN_2(keyword.size(), 16), keyword.data(), (int)operands);
+			return fenceError(error, line, message);
+		}
+		for (INT_T i = 0; i < operands; ++i) {
+			size_t errorpos;
+			if (parseFloat(tokens[i], values[i], errorpos) != PARSE_OK) return fenceError(error, line, "invalid number");
+		}
+
+		if (area) {
+			if (!closeArea()) return false;
+			areaLine = line;
+			exclusion = equalsLower(keyword, "exclusion");
+		}
+		else if (equalsLower(keyword, "vertex")) {
+			if (areaLine < 0) return fenceError(error, line, "vertex before inclusion or exclusion");
+			north.push_back(values[0]);
+			east.push_back(values[1]);
+			lines.push_back((int32_t)line);
+		}
+		else {
+			(equalsLower(keyword, "floor") ? floor : ceiling) = values[0];
+			if (floor > ceiling) return fenceError(error, line, "floor is above ceiling");
+		}
+	}
+	if (!closeArea()) return false;
+
+	buildGrid();
+	return true;
+}
+
+
+INT_T Geofence::row(double north) const {
+	double at = std::floor((north - north0) / cellSize);
+	return (INT_T)MIN_2(MAX_2(at, 0.0), (double)(rows - 1));
+}
+
+
+INT_T Geofence::column(double east) const {
+	double at = std::floor((east - east0) / cellSize);
+	return (INT_T)MIN_2(MAX_2(at, 0.0), (double)(columns - 1));
+}
+
+
+// Cells are found a row at a time from the east extent of the part
+// of the segment in the row. Rows and extents are widened by a
+// millionth of a cell so rounding never misses the cell a crossing
+// found by locate() is counted in.
+template <typename Visit>
+bool Geofence::traverse(double northA, double eastA, double northB, double eastB, Visit visit) const {
+	if (rows == 0) return true;
+	if (northA > northB) {
+		std::swap(northA, northB);
+		std::swap(eastA, eastB);
+	}
+	double pad = cellSize * 1e-6;
+	INT_T last = row(northB + pad);
+	for (INT_T r = row(northA - pad); r <= last; ++r) {
+		double low = MAX_2(northA, north0 + r * cellSize - pad);
+		double high = MIN_2(northB, north0 + (r + 1) * cellSize + pad);
+		if (low > high) continue;
+		double eastLow = eastA, eastHigh = eastB;
+		if (northB > northA) {
+			double slope = (eastB - eastA) / (northB - northA);
+			eastLow = eastA + (low - northA) * slope;
+			eastHigh = eastA + (high - northA) * slope;
+		}
+		INT_T first = column(MIN_2(eastLow, eastHigh) - pad);
+		INT_T end = column(MAX_2(eastLow, eastHigh) + pad);
+		for (INT_T c = first; c <= end; ++c) {
+			if (!visit(r * columns + c)) return false;
+		}
+	}
+	return true;
+}
+
+
+// grid over the edges' extent with cells of about one edge each
+void Geofence::buildGrid() {
+	rows = columns = 0;
+	cellStart.clear();
+	cellEdges.clear();
+	if (edgeList.empty()) return;
+
+	double northMin = HUGE_VAL, northMax = -HUGE_VAL, eastMin = HUGE_VAL, eastMax = -HUGE_VAL;
+	for (auto& edge : edgeList) {
+		for (INT_T i = 0; i < 2; ++i) {
+			northMin = MIN_2(northMin, edge.north[i]);
+			northMax = MAX_2(northMax, edge.north[i]);
+			eastMin = MIN_2(eastMin, edge.east[i]);
+			eastMax = MAX_2(eastMax, edge.east[i]);
+		}
+	}
+	double height = northMax - northMin, width = eastMax - eastMin;
+	double count = (double)edgeList.size();
+	// no more rows or columns than edges, however thin the fence
+	cellSize = MAX_2(std::sqrt(height * width / count), MAX_2(height, width) / count);
+	north0 = northMin;
+	east0 = eastMin;
+	rows = (INT_T)(height / cellSize) + 1;
+	columns = (INT_T)(width / cellSize) + 1;
+
+	// count each cell's edges, then fill them in place
+	cellStart.assign((size_t)rows * columns + 1, 0);
+	for (auto& edge : edgeList) {
+		traverse(edge.north[0], edge.east[0], edge.north[1], edge.east[1], [&](INT_T cell) {
+			++cellStart[cell + 1];
+			return true;
+		});
+	}
+	for (size_t i = 1; i < cellStart.size(); ++i) cellStart[i] += cellStart[i - 1];
+	cellEdges.resize(cellStart.back());
+	std::vector<uint32_t> fill(cellStart.begin(), cellStart.end() - 1);
+	for (uint32_t e = 0; e < edgeList.size(); ++e) {
+		const FenceEdge& edge = edgeList[e];
+		traverse(edge.north[0], edge.east[0], edge.north[1], edge.east[1], [&](INT_T cell) {
+			cellEdges[fill[cell]++] = e;
+			return true;
+		});
+	}
+}
+
+
+FenceBreach Geofence::locate(double north, double east, double altitude) const {
+	if (!(altitude >= floor)) return FENCE_BELOW;
+	if (!(altitude <= ceiling)) return FENCE_ABOVE;
+	return locateArea(north, east);
+}
+
+
+// Winding numbers along a ray from the position to the nearer east
+// or west side of the grid. An edge can be in several cells of the
+// row, so a crossing only counts in the cell it falls in. A position
+// on an edge is taken to be just east of it, or just north of it if
+// it runs east to west, whichever way the ray goes.
+FenceBreach Geofence::locateArea(double north, double east) const {
+	int32_t included = 0, excluded = 0;
+	if (rows > 0) {
+		INT_T r = row(north);
+		INT_T c = column(east);
+		bool west = c < columns - 1 - c;
+		INT_T first = west ? 0 : c, last = west ? c : columns - 1;
+		for (INT_T cell = r * columns + first; cell <= r * columns + last; ++cell) {
+			for (uint32_t i = cellStart[cell]; i < cellStart[cell + 1]; ++i) {
+				const FenceEdge& edge = edgeList[cellEdges[i]];
+				bool upward = edge.north[1] > north;
+				if ((edge.north[0] > north) == upward) continue;
+				double at = edge.east[0] + (north - edge.north[0]) * (edge.east[1] - edge.east[0]) / (edge.north[1] - edge.north[0]);
+				if ((west ? at > east : at <= east) || r * columns + column(at) != cell) continue;
+				int32_t winding = upward == west ? -edge.winding : edge.winding;
+				(edge.exclusion ? excluded : included) += winding;
+			}
+		}
+	}
+	if (hasInclusion && included <= 0) return FENCE_OUTSIDE;
+	if (excluded > 0) return FENCE_EXCLUDED;
+	return FENCE_INSIDE;
+}
+
+
+// positive if c is to the left of a to b
+static inline double turn(double northA, double eastA, double northB, double eastB, double northC, double eastC) {
+	return (northB - northA) * (eastC - eastA) - (eastB - eastA) * (northC - northA);
+}
+
+
+// A segment that crosses an edge leaves the area. One that only
+// touches edges, through their vertices or along them, is cut where
+// it touches and leaves if the middle of some piece is not inside.
+INT_T Geofence::crossing(double northA, double eastA, double northB, double eastB) const {
+	double northLeg = northB - northA, eastLeg = eastB - eastA;
+	double length2 = northLeg * northLeg + eastLeg * eastLeg;
+	if (length2 == 0) return -1;
+	INT_T line = -1;
+	// fraction of the way along the segment and fence line of each touch
+	std::vector<std::pair<double, int32_t>> touches;
+	traverse(northA, eastA, northB, eastB, [&](INT_T cell) {
+		for (uint32_t i = cellStart[cell]; i < cellStart[cell + 1]; ++i) {
+			const FenceEdge& edge = edgeList[cellEdges[i]];
+			double side0 = turn(northA, eastA, northB, eastB, edge.north[0], edge.east[0]);
+			double side1 = turn(northA, eastA, northB, eastB, edge.north[1], edge.east[1]);
+			if (side0 * side1 > 0) continue;
+			double sideA = turn(edge.north[0], edge.east[0], edge.north[1], edge.east[1], northA, eastA);
+			double sideB = turn(edge.north[0], edge.east[0], edge.north[1], edge.east[1], northB, eastB);
+			if (sideA * sideB > 0) continue;
+			if (side0 * side1 < 0 && sideA * sideB < 0) {
+				line = edge.line;
+				return false;
+			}
+			// an end of the segment on the edge, or a vertex on the segment
+			if (sideA == 0) touches.push_back({ 0.0, edge.line });
+			if (sideB == 0) touches.push_back({ 1.0, edge.line });
+			for (INT_T v = 0; v < 2; ++v) {
+				if ((v ? side1 : side0) != 0) continue;
+				double t = ((edge.north[v] - northA) * northLeg + (edge.east[v] - eastA) * eastLeg) / length2;
+				if (t > 0 && t < 1) touches.push_back({ t, edge.line });
+			}
+		}
+		return true;
+	});
+	if (line >= 0 || touches.empty()) return line;
+
+	std::sort(touches.begin(), touches.end());
+	double start = 0;
+	for (size_t i = 0; i <= touches.size() && start < 1; ++i) {
+		double end = i < touches.size() ? touches[i].first : 1;
+		if (end == start) continue;
+		double t = (start + end) / 2;
+		if (locateArea(northA + t * northLeg, eastA + t * eastLeg) != FENCE_INSIDE) return touches[i == touches.size() ? i - 1 : i].second;
+		start = end;
+	}
+	return -1;
+}
+
+
+// Check every waypoint whose position is known against
+// options.geofence, and every leg between two that are inside it.
+// Waypoints are checked as written, before compact encoding moves
+// them by up to half a step.
+bool Assembler::checkFence() {
+	STAT_TIME(stats, STAT_ANALYSIS);
+	const Geofence& fence = *options.geofence;
+	diagnostics.file = 0;
+
+	// POINT_LLA from home, three per geo point
+	std::vector<float> llaPositions;
+	bool lla = false;
+	for (auto& op : instructions) lla |= op.opcode == POINT_LLA;
+	if (lla) {
+		if (homeLine < 0) {
+			diagnostics.report(DIAG_NO_HOME, -1);
+			return false;
+		}
+		size_t count = geoPoints.size();
+		std::vector<double> buffer(count * 6);
+		double* latitude = buffer.data();
+		double* longitude = latitude + count;
+		double* altitude = longitude + count;
+		for (size_t i = 0; i < count; ++i) {
+			latitude[i] = geoPoints[i].latitude;
+			longitude[i] = geoPoints[i].longitude;
+			altitude[i] = geoPoints[i].altitude;
+		}
+		double* north = altitude + count;
+		double* east = north + count;
+		double* down = east + count;
+		llaToNed(nedFrame(home), latitude, longitude, altitude, count, north, east, down);
+		llaPositions.resize(count * 3);
+		for (size_t i = 0; i < count; ++i) {
+			llaPositions[i * 3] = (float)north[i];
+			llaPositions[i * 3 + 1] = (float)east[i];
+			llaPositions[i * 3 + 2] = (float)down[i];
+		}
+	}
+
+	std::vector<Waypoint> waypoints;
+	traceWaypoints(waypoints, lla ? &llaPositions : nullptr);
+	for (size_t i = 0; i < waypoints.size(); ++i) {
+		const float* at = waypoints[i].position;
+		INT_T line = instructions[waypoints[i].index].line;
+		diagnostics.file = instructions[waypoints[i].index].file;
+		FenceBreach breach = fence.locate(at[0], at[1], -(double)at[2]);
+		if (breach != FENCE_INSIDE) {
+			diagnostics.report(DIAG_OUTSIDE_FENCE, line, -1, {}, breach);
+			// so the legs either side are not reported too
+			waypoints[i].joined = false;
+			if (i + 1 < waypoints.size()) waypoints[i + 1].joined = false;
+			continue;
+		}
+		if (!waypoints[i].joined) continue;
+		const float* from = waypoints[i - 1].position;
+		INT_T edge = fence.crossing(from[0], from[1], at[0], at[1]);
+		if (edge >= 0) diagnostics.report(DIAG_LEAVES_FENCE, line, -1, {}, instructions[waypoints[i - 1].index].line, edge);
+	}
+	return diagnostics.errors() == 0;
+}
@@ -0,0 +1,89 @@
+// areas and altitudes routes are checked against
+
+#ifndef GEOFENCE_H
+#define GEOFENCE_H
+
+#include "util.h"
+
+// what a waypoint is outside of
+enum FenceBreach : int32_t {
+	FENCE_INSIDE,
+	// no inclusion area holds it
+	FENCE_OUTSIDE,
+	// an exclusion area holds it
+	FENCE_EXCLUDED,
+	FENCE_BELOW,
+	FENCE_ABOVE
+};
+
+// one side of an area, first to second vertex
+struct FenceEdge {
+	double north[2];
+	double east[2];
+	// fence line of the first vertex
+	int32_t line;
+	int16_t exclusion;
+	// +1 or -1, so crossings sum to 1 inside the area whichever way
+	// round its vertices are
+	int16_t winding;
+};
+
+// Areas a route may and may not fly in and the altitudes it must
+// keep between, in metres north and east of home as POINT has them
+// and altitude above home. Read from text with one item a line,
+// ';' starts a comment:
+//  inclusion           the vertices after it bound an area to stay in
+//  exclusion           the vertices after it bound an area to keep out of
+//  vertex north east   a corner, each area closes back to its first
+//  floor metres        lowest altitude allowed
+//  ceiling metres      highest altitude allowed
+// A position is inside if some inclusion holds it, or there are no
+// inclusions, and no exclusion does. Inclusions should not overlap,
+// a segment crossing the edge of one is taken to leave it.
+//
+// Edges are bucketed in a grid of about one edge a cell. A position
+// is located by counting crossings from it to the nearer side of the
+// grid along its row, and a segment by testing the edges of the cells
+// it passes through, so neither looks at the whole fence. Queries are
+// const and may run on several threads.
+class Geofence {
+public:
+	// false with error set, naming the line, if text is not a fence
+	bool parse(std::string_view text, std::string& error);
+
+	FenceBreach locate(double north, double east, double altitude) const;
+	// fence line of an edge where the segment between two positions
+	// leaves the areas, by crossing it or by touching it and going
+	// outside, -1 if it stays in
+	INT_T crossing(double north0, double east0, double north1, double east1) const;
+
+	const std::vector<FenceEdge>& edges() const { return edgeList; }
+	double floor = -HUGE_VAL;
+	double ceiling = HUGE_VAL;
+
+private:
+	void buildGrid();
+	// locate() without the altitude limits
+	FenceBreach locateArea(double north, double east) const;
+	INT_T row(double north) const;
+	INT_T column(double east) const;
+	// calls visit(cell) for every cell the segment passes through, or
+	// until it returns false
+	template <typename Visit>
+	bool traverse(double north0, double east0, double north1, double east1, Visit visit) const;
+
+	std::vector<FenceEdge> edgeList;
+	bool hasInclusion = false;
+
+	// cell at row r and column c holds cellEdges[cellStart[i]] up to
+	// cellEdges[cellStart[i + 1]], i = r * columns + c
+	double north0 = 0;
+	double east0 = 0;
+	double cellSize = 1;
+	INT_T rows = 0;
+	INT_T columns = 0;
+	std::vector<uint32_t> cellStart;
+	std::vector<uint32_t> cellEdges;
+};
+
+#endif
@@ -0,0 +1,373 @@
+#include "incremental.h"
+#include "mnemonic.h"
+#include "lexer.h"
+
+
+// instructions block nesting and the END checks depend on
+static bool isStructural(uint8_t opcode) {
+	switch (opcode) {
+	case WHILE:
+	case WHILE_VAR:
+	case ENDWHILE:
+	case BREAK_WHILE:
+	case FOR:
+	case FOR_VAR:
+	case ENDFOR:
+	case IF_Z:
+	case IF_NZ:
+	case IF_POS:
+	case IF_NEG:
+	case ENDIF:
+	case END:
+		return true;
+	default:
+		return false;
+	}
+}
+
+
+// split text into lines as Lexer counts them, a final
+// newline does not start another line
+static void splitLines(std::string_view text, std::vector<std::string_view>& lines) {
+	size_t start = 0;
+	while (start < text.size()) {
+		size_t end = text.find('\n', start);
+		if (end == std::string_view::npos) end = text.size();
+		lines.push_back(text.substr(start, end - start));
+		start = end + 1;
+	}
+}
+
+
+static bool equalsIgnoreCase(std::string_view a, std::string_view b) {
+	if (a.size() != b.size()) return false;
+	for (size_t i = 0; i < a.size(); ++i) {
+		if (asciiLower(a[i]) != asciiLower(b[i])) return false;
+	}
+	return true;
+}
+
+
+// parse a line on its own, names are resolved separately
+void IncrementalAssembler::parse(Line& line, INT_T index) {
+	line.state = LINE_BLANK;
+	Lexer lexer(line.text);
+	if (!lexer.nextLine()) return;
+	std::string_view token = lexer.nextToken();
+	if (token.empty()) return;
+
+	const Mnemonic* mnemonic = findMnemonic(token);
+	std::string_view names[3];
+	reporter.linenumber = index + 1;
+	// the opcode is kept for lines with bad operands for block checks
+	line.op = {};
+	if (!mnemonic || !reporter.parseLine(lexer, mnemonic, line.op, names)) {
+		// log() makes the message again with the line's number at the time
+		reporter.diagnostics.clear();
+		line.state = LINE_PARSE_ERROR;
+		return;
+	}
+
+	for (INT_T i = 0; i < 3; ++i) {
+		line.nameStart[i] = names[i].empty() ? 0 : names[i].data() - line.text.data();
+		line.nameLength[i] = names[i].size();
+	}
+	line.state = LINE_OK;
+}
+
+
+// resolve the names of a parsed line, declaring new variables only
+// when declare is set. A variable must be declared on an earlier line
+void IncrementalAssembler::resolve(INT_T index, bool declare) {
+	Line& line = *lines[index];
+	if (!parsed(line)) return;
+	line.state = LINE_OK;
+
+	const Mnemonic* mnemonic = findOpcode(line.op.opcode);
+	INT_T vars = 0;
+	for (INT_T i = 0; i < mnemonic->count; ++i) {
+		std::string_view variable = name(line, i);
+		INT_T slot;
+		if (mnemonic->operands[i] == OPERAND_VAR) {
+			slot = symbols.find(variable);
+			if (slot >= 0 && declaredAt[slot] >= index) slot = -1;
+		}
+		else if (mnemonic->operands[i] == OPERAND_DECL) {
+			slot = symbols.find(variable);
+			if (slot < 0 && declare && symbols.size() < SymbolTable::MAX_SYMBOLS) {
+				slot = symbols.size();
+				symbolNames[slot].assign(variable);
+				symbols.declare(symbolNames[slot]);
+				declaredAt[slot] = index;
+			}
+		}
+		else continue;
+
+		if (slot < 0) {
+			line.state = LINE_NAME_ERROR;
+			return;
+		}
+		line.op.vars[vars++] = (uint8_t)slot;
+	}
+}
+
+
+// assign every slot again in declaration order
+void IncrementalAssembler::resolveAll() {
+	symbols.clear();
+	errors = 0;
+	for (INT_T i = 0; i < _INT(lines.size()); ++i) {
+		resolve(i, true);
+		if (lines[i]->state >= LINE_PARSE_ERROR) ++errors;
+	}
+}
+
+
+// check block nesting and find the last END, as Assembler
+// does lines with bad operands still open and close blocks
+void IncrementalAssembler::checkStructure() {
+	reporter.blocks.clear();
+	blockError = -1;
+	lastEnd = -1;
+	for (INT_T i = 0; i < _INT(lines.size()); ++i) {
+		const Line& line = *lines[i];
+		if (line.state == LINE_BLANK || !isStructural(line.op.opcode)) continue;
+		if (line.op.opcode == END) lastEnd = i;
+		reporter.linenumber = i + 1;
+		if (!reporter.checkBlock(line.op.opcode) && blockError < 0) blockError = i;
+	}
+	unclosed = !reporter.blocks.empty();
+	reporter.diagnostics.clear();
+}
+
+
+uint8_t IncrementalAssembler::lineSize(const Line& line) {
+	return line.state == LINE_OK ? instructionSize(line.op.opcode) : 0;
+}
+
+
+size_t IncrementalAssembler::lineOffset(INT_T index) {
+	if (offsets.size() < lines.size() + 1) offsets.resize(lines.size() + 1);
+	if (offsetsValid == 0) {
+		offsets[0] = 0;
+		offsetsValid = 1;
+	}
+	for (; offsetsValid <= index; ++offsetsValid) {
+		offsets[offsetsValid] = offsets[offsetsValid - 1] + sizes[offsetsValid - 1];
+	}
+	return offsets[index];
+}
+
+
+void IncrementalAssembler::encodeAll() {
+	offsetsValid = 0;
+	size_t total = 0;
+	sizes.resize(lines.size());
+	for (INT_T i = 0; i < _INT(lines.size()); ++i) {
+		sizes[i] = lineSize(*lines[i]);
+		total += sizes[i];
+	}
+	bytes.resize(total);
+	size_t offset = 0;
+	for (INT_T i = 0; i < _INT(lines.size()); ++i) {
+		if (sizes[i] == 0) continue;
+		encodeOp(lines[i]->op, bytes.data() + offset);
+		offset += sizes[i];
+	}
+}
+
+
+bool IncrementalAssembler::assemble(std::string inputpath, std::string_view source) {
+	this->inputpath = std::move(inputpath);
+	reporter.diagnostics.path = this->inputpath;
+	messagesValid = false;
+
+	std::vector<std::string_view> texts;
+	splitLines(source, texts);
+	lines.clear();
+	lines.reserve(texts.size());
+	for (INT_T i = 0; i < _INT(texts.size()); ++i) {
+		lines.push_back(std::make_unique<Line>());
+		lines[i]->text.assign(texts[i]);
+		parse(*lines[i], i);
+	}
+
+	resolveAll();
+	checkStructure();
+	encodeAll();
+	changed = 0;
+	return success();
+}
+
+
+bool IncrementalAssembler::edit(INT_T first, INT_T count, std::string_view text) {
+	messagesValid = false;
+	INT_T index = first - 1;
+	if (index < 0 || count < 0 || index + count > _INT(lines.size())) {
+		messages = inputpath + ": Error: edit outside the route\n";
+		messagesValid = true;
+		return false;
+	}
+
+	std::vector<std::string_view> texts;
+	splitLines(text, texts);
+	INT_T added = texts.size();
+
+	// byte range the replaced lines encode to
+	size_t offset = lineOffset(index), oldSize = 0;
+	for (INT_T i = index; i < index + count; ++i) oldSize += sizes[i];
+	offsetsValid = MIN_2(offsetsValid, index + 1);
+
+	// declarations and structure of the replaced lines
+	std::vector<std::string_view> oldNames, newNames;
+	bool structural = false;
+	auto survey = [&](const Line& line, std::vector<std::string_view>& declared) {
+		if (line.state == LINE_BLANK) return;
+		structural |= isStructural(line.op.opcode);
+		if (!parsed(line)) return;
+		const Mnemonic* mnemonic = findOpcode(line.op.opcode);
+		for (INT_T i = 0; i < mnemonic->count; ++i) {
+			if (mnemonic->operands[i] == OPERAND_DECL) declared.push_back(name(line, i));
+		}
+	};
+	for (INT_T i = index; i < index + count; ++i) {
+		survey(*lines[i], oldNames);
+		if (lines[i]->state >= LINE_PARSE_ERROR) --errors;
+	}
+
+	std::vector<std::unique_ptr<Line>> replacement(added);
+	for (INT_T i = 0; i < added; ++i) {
+		replacement[i] = std::make_unique<Line>();
+		replacement[i]->text.assign(texts[i]);
+		parse(*replacement[i], index + i);
+		survey(*replacement[i], newNames);
+	}
+
+	// views in oldNames point into lines about to be replaced
+	bool sameNames = oldNames.size() == newNames.size();
+	for (size_t i = 0; i < oldNames.size() && sameNames; ++i) sameNames = equalsIgnoreCase(oldNames[i], newNames[i]);
+
+	// move the new lines in, shifting the rest only if the count changed
+	INT_T common = MIN_2(count, added);
+	for (INT_T i = 0; i < common; ++i) lines[index + i] = std::move(replacement[i]);
+	if (added > count) {
+		lines.insert(lines.begin() + index + count, std::make_move_iterator(replacement.begin() + count),
+			std::make_move_iterator(replacement.end()));
+		sizes.insert(sizes.begin() + index + count, added - count, 0);
+	}
+	else if (count > added) {
+		lines.erase(lines.begin() + index + added, lines.begin() + index + count);
+		sizes.erase(sizes.begin() + index + added, sizes.begin() + index + count);
+	}
+	INT_T shift = added - count;
+
+	if (sameNames) {
+		// slots stay as they are, first declarations made in the
+		// replaced lines are now in the new ones
+		for (INT_T slot = 0; slot < symbols.size(); ++slot) {
+			if (declaredAt[slot] >= index + count) declaredAt[slot] += shift;
+			else if (declaredAt[slot] >= index) {
+				for (INT_T i = index; i < index + added; ++i) {
+					const Line& line = *lines[i];
+					if (!parsed(line) || line.op.opcode != INTEGER || !equalsIgnoreCase(name(line, 0), symbolNames[slot])) continue;
+					declaredAt[slot] = i;
+					break;
+				}
+			}
+		}
+
+		size_t newSize = 0;
+		for (INT_T i = index; i < index + added; ++i) {
+			resolve(i, false);
+			if (lines[i]->state >= LINE_PARSE_ERROR) ++errors;
+			sizes[i] = lineSize(*lines[i]);
+			newSize += sizes[i];
+		}
+
+		if (newSize > oldSize) bytes.insert(bytes.begin() + offset + oldSize, newSize - oldSize, 0);
+		else if (newSize < oldSize) bytes.erase(bytes.begin() + offset + newSize, bytes.begin() + offset + oldSize);
+		size_t at = offset;
+		for (INT_T i = index; i < index + added; ++i) {
+			if (sizes[i] == 0) continue;
+			encodeOp(lines[i]->op, bytes.data() + at);
+			at += sizes[i];
+		}
+	}
+	else {
+		// slots after the edit may have moved, lines before it keep theirs
+		resolveAll();
+		encodeAll();
+	}
+	changed = MIN_2(changed, offset);
+
+	if (structural) checkStructure();
+	else {
+		if (lastEnd >= index + count) lastEnd += shift;
+		if (blockError >= index + count) blockError += shift;
+	}
+
+	return success();
+}
+
+
+// report the errors of a line as Assembler does
+void IncrementalAssembler::reportLine(INT_T index) {
+	const Line& line = *lines[index];
+	reporter.linenumber = index + 1;
+	Lexer lexer(line.text);
+	lexer.nextLine();
+	std::string_view token = lexer.nextToken();
+	const Mnemonic* mnemonic = findMnemonic(token);
+	RouteOp op;
+	std::string_view names[3];
+	if (!mnemonic) {
+		reporter.diagnostics.report(DIAG_UNKNOWN_COMMAND, index + 1, lexer.column(token), token);
+		return;
+	}
+	if (!reporter.parseLine(lexer, mnemonic, op, names)) return;
+
+	for (INT_T i = 0; i < mnemonic->count; ++i) {
+		INT_T slot = symbols.find(names[i]);
+		if (mnemonic->operands[i] == OPERAND_VAR && (slot < 0 || declaredAt[slot] >= index)) {
+			reporter.diagnostics.report(DIAG_UNDEFINED_VARIABLE, index + 1, lexer.column(names[i]), names[i]);
+		}
+		else if (mnemonic->operands[i] == OPERAND_DECL && slot < 0) {
+			reporter.diagnostics.report(DIAG_TOO_MANY_VARIABLES, index + 1, lexer.column(names[i]), names[i]);
+		}
+	}
+}
+
+
+const std::string& IncrementalAssembler::log() {
+	if (messagesValid) return messages;
+	reporter.diagnostics.clear();
+	reporter.blocks.clear();
+
+	if (!success()) {
+		// go through every line in order, as Assembler would
+		for (INT_T i = 0; i < _INT(lines.size()); ++i) {
+			const Line& line = *lines[i];
+			if (line.state == LINE_BLANK) continue;
+			if (line.state >= LINE_PARSE_ERROR) reportLine(i);
+			if (isStructural(line.op.opcode)) {
+				reporter.linenumber = i + 1;
+				reporter.checkBlock(line.op.opcode);
+			}
+		}
+		reporter.checkFinished(lastEnd >= 0);
+	}
+
+	INT_T unreachableLine = -1;
+	for (INT_T i = lastEnd + 1; lastEnd >= 0 && i < _INT(lines.size()); ++i) {
+		if (parsed(*lines[i])) {
+			unreachableLine = i + 1;
+			break;
+		}
+	}
+	if (unreachableLine >= 0) reporter.diagnostics.report(DIAG_UNREACHABLE, unreachableLine);
+
+	messages.clear();
+	reporter.diagnostics.format(messages);
+	messagesValid = true;
+	return messages;
+}
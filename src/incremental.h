@@ -0,0 +1,108 @@
+// reassembly of a route as it is edited
+
+#ifndef INCREMENTAL_H
+#define INCREMENTAL_H
+
+#include "routeasm.h"
+
+#include <memory>
+
+// Keeps the parsed form and encoded bytes of every line of a
+// route so an edit only costs the lines it replaces.
+//
+// Variable slots are resolved again for the whole route only
+// when an edit adds, removes or reorders declarations, and block
+// nesting is checked again only when an edit touches a block
+// instruction or END. Messages are formatted when log() is
+// called, and are the same as Assembler gives for the text.
+//
+// Output is the default encoding, as Assembler gives without
+// options. Directives are not supported, a line starting with one
+// is an unknown command.
+class IncrementalAssembler {
+public:
+	// assemble source from scratch, inputpath is only used in messages
+	bool assemble(std::string inputpath, std::string_view source);
+	// replace count lines from first, counting from 1, with the lines
+	// of text. Empty text deletes lines, a final newline is optional
+	bool edit(INT_T first, INT_T count, std::string_view text);
+
+	// true if the route as it stands assembles
+	bool success() const { return errors == 0 && blockError < 0 && !unclosed && lastEnd >= 0; }
+	// assembled data, only valid when success() is true
+	const std::vector<uint8_t>& data() const { return bytes; }
+	// bytes from here to the end of data may have changed since
+	// the last clearChanged()
+	size_t changedFrom() const { return changed; }
+	void clearChanged() { changed = SIZE_MAX; }
+	// errors and warnings for the route as it stands
+	const std::string& log();
+
+	INT_T lineCount() const { return lines.size(); }
+
+private:
+	enum LineState : uint8_t {
+		LINE_BLANK,
+		LINE_OK,
+		// not an instruction, or operands that do not parse
+		LINE_PARSE_ERROR,
+		// undefined variable or too many variables
+		LINE_NAME_ERROR
+	};
+
+	struct Line {
+		std::string text;
+		RouteOp op;
+		// VAR and DECL names by operand position, offsets into text
+		uint32_t nameStart[3];
+		uint32_t nameLength[3];
+		LineState state;
+	};
+
+	static bool parsed(const Line& line) { return line.state == LINE_OK || line.state == LINE_NAME_ERROR; }
+	static std::string_view name(const Line& line, INT_T i) {
+		return std::string_view(line.text).substr(line.nameStart[i], line.nameLength[i]);
+	}
+
+	void parse(Line& line, INT_T index);
+	void resolve(INT_T index, bool declare);
+	void resolveAll();
+	void checkStructure();
+	void reportLine(INT_T index);
+	static uint8_t lineSize(const Line& line);
+	size_t lineOffset(INT_T index);
+	void encodeAll();
+
+	std::string inputpath;
+	// held by pointer so inserting and deleting lines moves little
+	std::vector<std::unique_ptr<Line>> lines;
+	// encoded size of each line, and the byte offset of each line
+	// worked out as far as offsetsValid, an edit only moves the
+	// lines after it so editing nearby lines is constant time
+	std::vector<uint8_t> sizes;
+	std::vector<uint32_t> offsets;
+	INT_T offsetsValid = 0;
+	std::vector<uint8_t> bytes;
+	size_t changed = 0;
+
+	// variable names own their text, the table views into it
+	SymbolTable symbols;
+	std::string symbolNames[SymbolTable::MAX_SYMBOLS];
+	// line index of the first declaration of each slot
+	INT_T declaredAt[SymbolTable::MAX_SYMBOLS];
+
+	// lines in an error state
+	INT_T errors = 0;
+	// first line with a block nesting error, -1 if none
+	INT_T blockError = -1;
+	bool unclosed = false;
+	// index of the last END line, -1 if none
+	INT_T lastEnd = -1;
+
+	// parses lines and formats messages
+	Assembler reporter;
+	std::string messages;
+	bool messagesValid = false;
+};
+
+#endif
@@ -0,0 +1,177 @@
+// single pass line and token reader over a source buffer
+
+#ifndef LEXER_H
+#define LEXER_H
+
+#include "util.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define LEXER_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define LEXER_SSE2
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// Splits source into lines and whitespace separated tokens.
+// Tokens are views into the source, nothing is copied and
+// the source does not need to be null terminated.
+// ';' starts a comment running to the end of the line.
+//
+// Source is classified 64 bytes at a time, with SSE2 or AVX2
+// where available, into a bitmask of events: token starts,
+// token ends, newlines and comment starts. Lines and tokens
+// are then read by popping bits in order, so each byte is
+// looked at once and line ends fall out of the same pass.
+class Lexer {
+public:
+	Lexer(std::string_view source) :
+		start(source.data()), end(source.data() + source.size()), size(source.size()) {}
+
+	// move to the next line, returns false at end of source
+	bool nextLine() {
+		if (linenumber == 0) {
+			linestart = start;
+		}
+		else {
+			// skip whatever is left of the line, including comments
+			const char* event;
+			while ((event = peek()) < end && *event != '\n') pop();
+			if (event >= end) return false;
+			pop();
+			linestart = event + 1;
+		}
+		if (linestart >= end) return false;
+		++linenumber;
+		return true;
+	}
+
+	// next token on the line, empty at end of line or comment
+	std::string_view nextToken() {
+		const char* token = peek();
+		if (token >= end || *token == '\n' || *token == ';') return std::string_view(token, 0);
+		pop();
+		// the next event always ends the token, it is left
+		// in place if it is also a newline or comment
+		const char* tokenend = peek();
+		if (tokenend < end && *tokenend != '\n' && *tokenend != ';') pop();
+		return std::string_view(token, tokenend - token);
+	}
+
+	INT_T line() const { return linenumber; }
+
+	// one based column of a token on the current line
+	INT_T column(std::string_view token) const { return token.data() - linestart + 1; }
+
+private:
+	static constexpr INT_T BLOCK = 64;
+
+	static INT_T ctz64(uint64_t value) {
+#ifdef _MSC_VER
+		unsigned long index;
+		_BitScanForward64(&index, value);
+		return index;
+#else
+		return __builtin_ctzll(value);
+#endif
+	}
+
+	// classify one block, bit i describes byte i
+	// space is ' ', '\t' and '\r'
+	static void classify(const char* p, uint64_t& newline, uint64_t& space, uint64_t& comment) {
+#if defined(LEXER_AVX2)
+		const __m256i nl = _mm256_set1_epi8('\n');
+		const __m256i sp = _mm256_set1_epi8(' ');
+		const __m256i tab = _mm256_set1_epi8('\t');
+		const __m256i cr = _mm256_set1_epi8('\r');
+		const __m256i semi = _mm256_set1_epi8(';');
+		uint64_t n = 0, s = 0, c = 0;
+		for (INT_T i = 0; i < BLOCK; i += 32) {
+			__m256i v = _mm256_loadu_si256((const __m256i*)(p + i));
+			__m256i issp = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, sp), _mm256_cmpeq_epi8(v, tab)), _mm256_cmpeq_epi8(v, cr));
+			n |= (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, nl)) << i;
+			s |= (uint64_t)(uint32_t)_mm256_movemask_epi8(issp) << i;
+			c |= (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, semi)) << i;
+		}
+#elif defined(LEXER_SSE2)
+		const __m128i nl = _mm_set1_epi8('\n');
+		const __m128i sp = _mm_set1_epi8(' ');
+		const __m128i tab = _mm_set1_epi8('\t');
+		const __m128i cr = _mm_set1_epi8('\r');
+		const __m128i semi = _mm_set1_epi8(';');
+		uint64_t n = 0, s = 0, c = 0;
+		for (INT_T i = 0; i < BLOCK; i += 16) {
+			__m128i v = _mm_loadu_si128((const __m128i*)(p + i));
+			__m128i issp = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, sp), _mm_cmpeq_epi8(v, tab)), _mm_cmpeq_epi8(v, cr));
+			n |= (uint64_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, nl)) << i;
+			s |= (uint64_t)_mm_movemask_epi8(issp) << i;
+			c |= (uint64_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, semi)) << i;
+		}
+#else
+		uint64_t n = 0, s = 0, c = 0;
+		for (INT_T i = 0; i < BLOCK; ++i) {
+			char ch = p[i];
+			n |= (uint64_t)(ch == '\n') << i;
+			s |= (uint64_t)(ch == ' ' || ch == '\t' || ch == '\r') << i;
+			c |= (uint64_t)(ch == ';') << i;
+		}
+#endif
+		newline = n;
+		space = s;
+		comment = c;
+	}
+
+	// classify the next block into events
+	void load() {
+		blockoffset = nextoffset;
+		nextoffset += BLOCK;
+		uint64_t newline, space, comment;
+		if (size - blockoffset >= (size_t)BLOCK) {
+			classify(start + blockoffset, newline, space, comment);
+		}
+		else {
+			// last partial block, padding reads as newlines so
+			// a token running to the end of source is closed
+			char buffer[BLOCK];
+			memset(buffer, '\n', BLOCK);
+			memcpy(buffer, start + blockoffset, size - blockoffset);
+			classify(buffer, newline, space, comment);
+		}
+
+		// a token starts after any stop character and ends on one
+		uint64_t stop = newline | space | comment;
+		uint64_t after = (stop << 1) | carry;
+		carry = stop >> 63;
+		events = (~stop & after) | (stop & ~after) | newline | comment;
+	}
+
+	// position of the next event, end if there are none left
+	const char* peek() {
+		while (!events) {
+			if (nextoffset >= size) return end;
+			load();
+		}
+		const char* event = start + blockoffset + ctz64(events);
+		return event < end ? event : end;
+	}
+
+	void pop() { events &= events - 1; }
+
+	const char* start;
+	const char* end;
+	size_t size;
+	const char* linestart = nullptr;
+	INT_T linenumber = 0;
+
+	// current block, the start of source counts as a stop
+	size_t blockoffset = 0;
+	size_t nextoffset = 0;
+	uint64_t events = 0;
+	uint64_t carry = 1;
+};
+
+#endif
@@ -0,0 +1,215 @@
+// linking object modules into one instruction list
+//
+// Every module's locals get slots of their own and each global one
+// slot for every module that uses it. Fragments are copied in where
+// they are used, before optimizing, so jump offsets and compact
+// waypoints are worked out over the linked route as a whole.
+
+#include "routeasm.h"
+#include "mnemonic.h"
+#include "module.h"
+
+#include <unordered_map>
+
+
+// lower case key for names, which compare ignoring case
+static std::string nameKey(std::string_view name) {
+	std::string key(name);
+	for (auto& c : key) c = asciiLower(c);
+	return key;
+}
+
+
+namespace {
+
+struct FragmentRef {
+	INT_T module;
+	INT_T fragment;
+
+	bool operator==(const FragmentRef& other) const { return module == other.module && fragment == other.fragment; }
+};
+
+// state while copying code into the linked route
+struct Linker {
+	const std::vector<ObjectModule>& modules;
+	Diagnostics& diagnostics;
+	std::vector<RouteOp>& out;
+	// per module, linked slot of each variable
+	std::vector<std::vector<uint8_t>> slots;
+	// per module, the fragment each use names, module -1 if none does
+	std::vector<std::vector<FragmentRef>> targets;
+	// per module, uses already reported so a fragment used
+	// many times gives one message
+	std::vector<std::vector<bool>> reported;
+	// fragments being copied, innermost last
+	std::vector<FragmentRef> active;
+	// per module, index of its first geo point in the linked route
+	std::vector<int32_t> geoBases;
+
+	void insert(INT_T module, const std::vector<RouteOp>& code);
+	void report(DiagnosticCode code, INT_T module, const RouteOp& op);
+};
+
+}
+
+
+void Linker::report(DiagnosticCode code, INT_T module, const RouteOp& op) {
+	if (reported[module][op.immediate]) return;
+	reported[module][op.immediate] = true;
+	diagnostics.file = module + 1;
+	diagnostics.report(code, op.line, -1, modules[module].uses[op.immediate]);
+}
+
+
+void Linker::insert(INT_T module, const std::vector<RouteOp>& code) {
+	for (auto& op : code) {
+		if (op.opcode != USE_FRAGMENT) {
+			out.push_back(op);
+			RouteOp& linked = out.back();
+			linked.file = (uint16_t)(module + 1);
+			const Mnemonic* mnemonic = findOpcode(op.opcode);
+			INT_T vars = 0;
+			for (INT_T i = 0; i < mnemonic->count; ++i) {
+				uint8_t type = mnemonic->operands[i];
+				if (type == OPERAND_VAR || type == OPERAND_DECL) {
+					linked.vars[vars] = slots[module][op.vars[vars]];
+					++vars;
+				}
+			}
+			if (op.opcode == POINT_LLA) linked.quanta[0] += geoBases[module];
+			continue;
+		}
+
+		FragmentRef target = targets[module][op.immediate];
+		if (target.module < 0) {
+			report(DIAG_UNDEFINED_SYMBOL, module, op);
+			continue;
+		}
+		if (contains(active, target)) {
+			report(DIAG_RECURSIVE_FRAGMENT, module, op);
+			continue;
+		}
+		active.push_back(target);
+		insert(target.module, modules[target.module].fragments[target.fragment].code);
+		active.pop_back();
+	}
+}
+
+
+bool Assembler::linkModules(const std::vector<ObjectModule>& modules) {
+	INT_T count = modules.size();
+	Linker linker = { modules, diagnostics, instructions, {}, {}, {}, {}, {} };
+	linker.slots.resize(count);
+	linker.targets.resize(count);
+	linker.reported.resize(count);
+
+	// one home for the route, and every module's geo points in order
+	homeLine = -1;
+	geoPoints.clear();
+	for (INT_T m = 0; m < count; ++m) {
+		const ObjectModule& module = modules[m];
+		linker.geoBases.push_back((int32_t)geoPoints.size());
+		geoPoints.insert(geoPoints.end(), module.geoPoints.begin(), module.geoPoints.end());
+		if (module.homeLine < 0) continue;
+		if (homeLine >= 0) {
+			diagnostics.file = m + 1;
+			diagnostics.report(DIAG_DUPLICATE_HOME, module.homeLine);
+			continue;
+		}
+		home = module.home;
+		homeLine = module.homeLine;
+	}
+
+	// slots in module order, so one module linked on its
+	// own keeps the slots it was parsed with
+	std::unordered_map<std::string, uint8_t> globalSlots;
+	INT_T next = 0;
+	for (INT_T m = 0; m < count; ++m) {
+		diagnostics.file = m + 1;
+		const auto& variables = modules[m].variables;
+		linker.slots[m].assign(variables.size(), 0);
+		for (size_t s = 0; s < variables.size(); ++s) {
+			const ModuleVariable& variable = variables[s];
+			if (variable.kind == SYMBOL_EXTERN) continue;
+			if (variable.kind == SYMBOL_GLOBAL) {
+				auto found = globalSlots.find(nameKey(variable.name));
+				if (found != globalSlots.end()) {
+					diagnostics.report(DIAG_DUPLICATE_SYMBOL, variable.line, -1, variable.name);
+					linker.slots[m][s] = found->second;
+					continue;
+				}
+			}
+			if (next == SymbolTable::MAX_SYMBOLS) {
+				diagnostics.report(DIAG_TOO_MANY_VARIABLES, variable.line, -1, variable.name);
+				break;
+			}
+			if (variable.kind == SYMBOL_GLOBAL) globalSlots[nameKey(variable.name)] = (uint8_t)next;
+			linker.slots[m][s] = (uint8_t)next++;
+		}
+	}
+	for (INT_T m = 0; m < count; ++m) {
+		diagnostics.file = m + 1;
+		const auto& variables = modules[m].variables;
+		for (size_t s = 0; s < variables.size(); ++s) {
+			if (variables[s].kind != SYMBOL_EXTERN) continue;
+			auto found = globalSlots.find(nameKey(variables[s].name));
+			if (found == globalSlots.end()) diagnostics.report(DIAG_UNDEFINED_SYMBOL, variables[s].line, -1, variables[s].name);
+			else linker.slots[m][s] = found->second;
+		}
+	}
+
+	// a use finds a fragment of its own module first, then an exported one
+	std::unordered_map<std::string, FragmentRef> exported;
+	for (INT_T m = 0; m < count; ++m) {
+		diagnostics.file = m + 1;
+		for (INT_T f = 0; f < _INT(modules[m].fragments.size()); ++f) {
+			const ModuleFragment& fragment = modules[m].fragments[f];
+			if (!fragment.exported) continue;
+			if (!exported.emplace(nameKey(fragment.name), FragmentRef{ m, f }).second) {
+				diagnostics.report(DIAG_DUPLICATE_SYMBOL, fragment.line, -1, fragment.name);
+			}
+		}
+	}
+	std::unordered_map<std::string, INT_T> local;
+	for (INT_T m = 0; m < count; ++m) {
+		const ObjectModule& module = modules[m];
+		local.clear();
+		for (INT_T f = 0; f < _INT(module.fragments.size()); ++f) local.emplace(nameKey(module.fragments[f].name), f);
+		linker.targets[m].assign(module.uses.size(), { -1, -1 });
+		linker.reported[m].assign(module.uses.size(), false);
+		for (size_t u = 0; u < module.uses.size(); ++u) {
+			std::string key = nameKey(module.uses[u]);
+			auto own = local.find(key);
+			if (own != local.end()) linker.targets[m][u] = { m, own->second };
+			else {
+				auto found = exported.find(key);
+				if (found != exported.end()) linker.targets[m][u] = found->second;
+			}
+		}
+	}
+
+	// the route starts with the only module with code outside fragments
+	INT_T main = -1;
+	for (INT_T m = 0; m < count; ++m) {
+		if (modules[m].code.empty()) continue;
+		if (main < 0) main = m;
+		else {
+			diagnostics.file = m + 1;
+			diagnostics.report(DIAG_MULTIPLE_MAIN, -1);
+		}
+	}
+	diagnostics.file = 0;
+	if (main < 0) {
+		diagnostics.report(DIAG_NO_MAIN, -1);
+		return false;
+	}
+
+	instructions.clear();
+	linker.insert(main, modules[main].code);
+	diagnostics.file = 0;
+	bool end = false;
+	for (auto& op : instructions) end |= op.opcode == END;
+	// a fragment that could not be found may have held the END
+	if (!end && diagnostics.errors() == 0) diagnostics.report(DIAG_NO_END, -1);
+	return diagnostics.errors() == 0;
+}
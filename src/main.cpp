@@ -0,0 +1,727 @@
+// command line interface, not built into AUTOPILOT_INTERFACE programs
+
+#ifndef AUTOPILOT_INTERFACE
+
+#include "routeasm.h"
+#include "threadpool.h"
+#include "cache.h"
+#include "disasm.h"
+#include "geofence.h"
+#include "module.h"
+
+
+void printHelp();
+
+
+#ifdef ROUTEASM_STATS
+// count every allocation for --stats
+void* operator new(size_t size) {
+	statAllocation(size);
+	if (void* memory = malloc(size ? size : 1)) return memory;
+	throw std::bad_alloc();
+}
+
+void operator delete(void* memory) noexcept {
+	free(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept {
+	free(memory);
+}
+#endif
+
+
+template <typename T1, typename T2>
+bool compare(T1 str1, T2 str2) {
+	return strcmp(str1, str2) == 0;
+}
+
+
+// make path absolute from the working directory
+// and use forward slashes throughout
+std::string fullpath(std::string file) {
+	std::string path = (std::filesystem::current_path() / file).string();
+	std::replace(path.begin(), path.end(), '\\', '/');
+	return path;
+}
+
+
+// append how many waypoints simplifying left out, if it ran
+void simplifyReport(const Assembler& assembler, const std::string& path, std::string& log) {
+	if (assembler.options.simplifyTolerance <= 0) return;
+	char buffer[128];
+	snprintf(buffer, sizeof(buffer), ": simplified away %zu waypoints, at most %.3f m from the route\n",
+		assembler.removedPoints, assembler.maxDeviation);
+	log.append(path).append(buffer);
+}
+
+
+// append how much compact waypoints saved, if they were used
+void pointReport(const Assembler& assembler, const std::string& path, std::string& log) {
+	if (assembler.options.pointResolution <= 0 || assembler.pointBytes == 0) return;
+	size_t size = assembler.data.size();
+	size_t raw = size - assembler.compactPointBytes + assembler.pointBytes;
+	char buffer[128];
+	snprintf(buffer, sizeof(buffer), ": points %zu -> %zu bytes, output %zu -> %zu bytes (%.1f%% smaller)\n",
+		assembler.pointBytes, assembler.compactPointBytes, raw, size, 100.0 * (double)(raw - size) / raw);
+	log.append(path).append(buffer);
+}
+
+
+// append the size of the leg table, if one was written
+void legReport(const Assembler& assembler, const std::string& path, std::string& log) {
+	if (!assembler.options.legTable) return;
+	double total = 0;
+	for (auto& leg : assembler.legs) total += leg.length;
+	char buffer[128];
+	snprintf(buffer, sizeof(buffer), ": %zu legs, %.1f m\n", assembler.legs.size(), total);
+	log.append(path).append(buffer);
+}
+
+
+// append the longest stretch between events, if there is a budget
+void stepsReport(const Assembler& assembler, const std::string& path, std::string& log) {
+	if (assembler.options.stepBudget <= 0) return;
+	char buffer[128];
+	snprintf(buffer, sizeof(buffer), ": at most %lld instructions between events, budget %d\n",
+		(long long)assembler.worstSteps, (int)assembler.options.stepBudget);
+	log.append(path).append(buffer);
+}
+
+
+// append how many slots the variables were packed into, if they were
+void slotsReport(const Assembler& assembler, const std::string& path, std::string& log) {
+	if (!assembler.options.reuseSlots) return;
+	char buffer[128];
+	snprintf(buffer, sizeof(buffer), ": %d variables in %d slots\n", (int)assembler.variableCount, (int)assembler.slotCount);
+	log.append(path).append(buffer);
+}
+
+
+// assemble one file, messages are appended to log
+// rather than printed so batch jobs do not interleave
+// cache may be null, only successful builds are stored
+// stats may be null, counts are added to it if not
+// pool may be null, long waypoint runs are simplified on it if not
+bool assemblefile(std::string inputfile, std::string outputfile, const AssemblerOptions& options, BuildCache* cache,
+	AssemblerStats* stats, ThreadPool* pool, std::string& log) {
+	STAT_ALLOCATIONS(stats);
+	std::string inputpath = fullpath(inputfile);
+	std::string outputpath = fullpath(outputfile);
+
+	MappedFile source;
+	bool opened;
+	{
+		STAT_TIME(stats, STAT_READ);
+		opened = source.open(inputpath);
+	}
+	if (!opened) {
+		log.append("Error opening file: ").append(inputpath).append("\n");
+		return false;
+	}
+
+	std::string key;
+	if (cache) {
+		key = BuildCache::key(inputpath, source.view(), options);
+		std::vector<uint8_t> data;
+		std::string cached;
+		if (cache->lookup(key, data, cached)) {
+			log.append(cached);
+			STAT_TIME(stats, STAT_WRITE);
+			writeDataToFile(outputpath, data.data(), data.size());
+			return true;
+		}
+	}
+
+	Assembler assembler;
+	assembler.options = options;
+	assembler.stats = stats;
+	assembler.pool = pool;
+	bool success = assembler.assemble(inputpath, source.view());
+	std::string messages;
+	assembler.diagnostics.format(messages);
+	if (!success) {
+		log.append(messages);
+		return false;
+	}
+
+	simplifyReport(assembler, inputpath, messages);
+	pointReport(assembler, inputpath, messages);
+	legReport(assembler, inputpath, messages);
+	stepsReport(assembler, inputpath, messages);
+	slotsReport(assembler, inputpath, messages);
+
+	if (cache) cache->store(key, assembler.data, messages);
+	log.append(messages);
+	STAT_TIME(stats, STAT_WRITE);
+	writeDataToFile(outputpath, assembler.data.data(), assembler.data.size());
+	return true;
+}
+
+
+// compile one file to an object module for --link,
+// messages are appended to log as for assemblefile()
+bool compilefile(std::string inputfile, std::string outputfile, std::string& log) {
+	std::string inputpath = fullpath(inputfile);
+	MappedFile source;
+	if (!source.open(inputpath)) {
+		log.append("Error opening file: ").append(inputpath).append("\n");
+		return false;
+	}
+
+	Assembler assembler;
+	ObjectModule module;
+	bool success = assembler.compile(inputpath, source.view(), module);
+	assembler.diagnostics.format(log);
+	if (!success) return false;
+
+	std::vector<uint8_t> data;
+	writeModule(module, data);
+	writeDataToFile(fullpath(outputfile), data.data(), data.size());
+	return true;
+}
+
+
+// link object modules into one route, threads is
+// for simplifying as for the batch thread count
+bool linkfiles(const std::vector<std::string>& inputs, std::string outputfile, const AssemblerOptions& options, INT_T threads) {
+	std::vector<ObjectModule> modules(inputs.size());
+	for (UINT_T i = 0; i < inputs.size(); ++i) {
+		std::string inputpath = fullpath(inputs[i]);
+		MappedFile file;
+		if (!file.open(inputpath)) {
+			std::cout << "Error opening file: " << inputpath << "\n";
+			return false;
+		}
+		std::string error;
+		if (!readModule((const uint8_t*)file.data(), file.size(), modules[i], error)) {
+			std::cout << inputpath << ": Error: " << error << "\n";
+			return false;
+		}
+	}
+
+	std::string outputpath = fullpath(outputfile);
+	Assembler assembler;
+	assembler.options = options;
+	std::unique_ptr<ThreadPool> pool;
+	if (options.simplifyTolerance > 0) assembler.pool = (pool = std::make_unique<ThreadPool>(threads)).get();
+	bool success = assembler.link(outputpath, modules);
+	std::string messages;
+	assembler.diagnostics.format(messages);
+	if (success) {
+		assembler.data.resize(assembler.serializedSize());
+		assembler.serialize(assembler.data.data());
+		simplifyReport(assembler, outputpath, messages);
+		pointReport(assembler, outputpath, messages);
+		legReport(assembler, outputpath, messages);
+		stepsReport(assembler, outputpath, messages);
+		slotsReport(assembler, outputpath, messages);
+		writeDataToFile(outputpath, assembler.data.data(), assembler.data.size());
+	}
+	std::cout << messages;
+	return success;
+}
+
+
+// read an assembled file back, writing a listing to outputfile
+// or standard output if that is empty, and or a size report and
+// step report
+bool inspectfile(std::string inputfile, std::string outputfile, bool listing, bool report, bool steps) {
+	MappedFile binary;
+	if (!binary.open(fullpath(inputfile))) {
+		std::cout << "Error opening file: " << fullpath(inputfile) << "\n";
+		return false;
+	}
+	const uint8_t* data = (const uint8_t*)binary.data();
+	std::string error;
+
+	if (listing) {
+		bool success;
+		if (outputfile.empty()) success = disassemble(data, binary.size(), std::cout, error);
+		else {
+			std::ofstream f(fullpath(outputfile), std::ofstream::trunc);
+			success = disassemble(data, binary.size(), f, error);
+		}
+		if (!success) {
+			std::cout << "Error: " << error << "\n";
+			return false;
+		}
+	}
+
+	if (report) {
+		SizeReport sizes;
+		if (!sizeReport(data, binary.size(), sizes, error)) {
+			std::cout << "Error: " << error << "\n";
+			return false;
+		}
+		std::string text;
+		sizes.format(text);
+		std::cout << text;
+	}
+
+	if (steps) {
+		StepReport stretches;
+		if (!stepReport(data, binary.size(), stretches, error)) {
+			std::cout << "Error: " << error << "\n";
+			return false;
+		}
+		std::string text;
+		stretches.format(text);
+		std::cout << text;
+	}
+	return true;
+}
+
+
+// read input file list, one path per line
+// blank lines and lines starting with ';' are skipped
+// relative paths are taken from the manifest's directory
+bool readManifest(std::string manifest, std::vector<std::string>& inputs) {
+	std::string filestring;
+	if (!readFileToString(manifest, filestring)) {
+		std::cout << "Error opening manifest: " << manifest << "\n";
+		return false;
+	}
+
+	std::filesystem::path base = std::filesystem::path(manifest).parent_path();
+	std::stringstream lines(filestring);
+	std::string line;
+	while (std::getline(lines, line)) {
+		// trim whitespace both ends
+		size_t first = line.find_first_not_of(" \t\r");
+		if (first == std::string::npos || line[first] == ';') continue;
+		size_t last = line.find_last_not_of(" \t\r");
+		std::filesystem::path file = line.substr(first, last - first + 1);
+		inputs.push_back(file.is_absolute() ? file.string() : (base / file).string());
+	}
+
+	return true;
+}
+
+
+// assemble every input on a shared thread pool, each output is
+// written to outdir with the input's name and a .bin extension,
+// or compiled to a .rao object module if compileonly is set
+// stats, if set, gets the totals and each file's log its own
+bool assemblebatch(std::vector<std::string>& inputs, std::string outdir, INT_T threads, const AssemblerOptions& options,
+	bool compileonly, BuildCache* cache, AssemblerStats* stats) {
+	namespace fs = std::filesystem;
+
+	std::vector<std::string> outputs;
+	std::vector<std::string> seen;
+	for (auto& input : inputs) {
+		fs::path output = fs::path(outdir) / fs::path(input).stem();
+		output += compileonly ? ".rao" : ".bin";
+		std::string outputpath = fullpath(output.string());
+		if (contains(seen, outputpath)) {
+			std::cout << "Error: more than one input writes to " << outputpath << "\n";
+			return false;
+		}
+		seen.push_back(outputpath);
+		outputs.push_back(output.string());
+	}
+
+	if (!outdir.empty()) {
+		std::error_code error;
+		fs::create_directories(outdir, error);
+		if (error) {
+			std::cout << "Error: could not create output directory " << outdir << "\n";
+			return false;
+		}
+	}
+
+	std::vector<std::string> logs(inputs.size());
+	// not vector<bool>, every task writes its own element
+	std::vector<uint8_t> results(inputs.size(), 0);
+	std::vector<AssemblerStats> filestats(stats ? inputs.size() : 0);
+	{
+		ThreadPool pool(threads);
+		for (UINT_T i = 0; i < inputs.size(); ++i) {
+			pool.submit([&, i] {
+				if (compileonly) results[i] = compilefile(inputs[i], outputs[i], logs[i]);
+				// files are already spread over the pool, so each simplifies on its own thread
+				else results[i] = assemblefile(inputs[i], outputs[i], options, cache, stats ? &filestats[i] : nullptr, nullptr, logs[i]);
+				if (stats) {
+					logs[i].append(fullpath(inputs[i])).append(":\n");
+					filestats[i].format(logs[i]);
+				}
+			});
+		}
+		pool.wait();
+	}
+	for (auto& file : filestats) stats->add(file);
+
+	// print in input order so output is the same for any thread count
+	UINT_T failed = 0;
+	for (UINT_T i = 0; i < inputs.size(); ++i) {
+		std::cout << logs[i];
+		if (!results[i]) ++failed;
+	}
+
+	std::cout << inputs.size() - failed << " succeeded, " << failed << " failed\n";
+	for (UINT_T i = 0; i < inputs.size(); ++i) {
+		if (!results[i]) std::cout << "Failed: " << inputs[i] << "\n";
+	}
+
+	return failed == 0;
+}
+
+
+int main(int argc, char** argv) {
+	INT_T ret = 0;
+	std::vector<std::string> inputs;
+	std::string outputfile = "a.bin";
+	std::string outdir;
+	INT_T threads = 0;
+	AssemblerOptions options;
+	bool batch = false;
+	bool outputgiven = false;
+	std::string cachedir;
+	// megabytes
+	INT_T cachesize = 256;
+	BuildCache cache;
+	bool showstats = false;
+	AssemblerStats stats;
+	bool listing = false;
+	bool report = false;
+	bool steps = false;
+	bool compileonly = false;
+	bool linking = false;
+	Geofence geofence;
+
+	INT_T i = 1;
+	while (i < argc) {
+		switch (*argv[i]) {
+		case '-':
+			if (*(argv[i] + 1) == '-') {
+				if (compare(argv[i], "--help")) {
+					printHelp();
+					goto end;
+				}
+				else if (compare(argv[i], "--jumps")) {
+					options.jumpOffsets = true;
+				}
+				else if (compare(argv[i], "--lla-to-ned")) {
+					options.llaToNed = true;
+				}
+				else if (compare(argv[i], "--legs")) {
+					options.legTable = true;
+				}
+				else if (compare(argv[i], "--reuse-slots")) {
+					options.reuseSlots = true;
+				}
+				else if (compare(argv[i], "--link")) {
+					linking = true;
+				}
+				else if (compare(argv[i], "--disasm")) {
+					listing = true;
+				}
+				else if (compare(argv[i], "--size-report")) {
+					report = true;
+				}
+				else if (compare(argv[i], "--step-report")) {
+					steps = true;
+				}
+				else if (compare(argv[i], "--step-budget")) {
+					int32_t budget;
+					size_t errorpos;
+					if (++i >= argc || parseInt(argv[i], budget, 1, INT32_MAX, errorpos) != PARSE_OK) {
+						std::cout << "Error: --step-budget requires an instruction count\n";
+						ret = -1;
+						goto end;
+					}
+					options.stepBudget = budget;
+				}
+				else if (compare(argv[i], "--stats")) {
+#ifdef ROUTEASM_STATS
+					showstats = true;
+#else
+					std::cout << "Error: --stats needs a build with ROUTEASM_STATS defined\n";
+					ret = -1;
+					goto end;
+#endif
+				}
+				else if (compare(argv[i], "--unroll")) {
+					int32_t limit;
+					size_t errorpos;
+					if (++i < argc && parseInt(argv[i], limit, 1, INT32_MAX, errorpos) == PARSE_OK) {
+						options.unrollLimit = limit;
+						options.optimize = true;
+					}
+					else {
+						std::cout << "Error: --unroll requires an instruction count\n";
+						ret = -1;
+						goto end;
+					}
+				}
+				else if (compare(argv[i], "--point-resolution")) {
+					size_t errorpos;
+					if (++i >= argc || parseFloat(argv[i], options.pointResolution, errorpos) != PARSE_OK || options.pointResolution <= 0) {
+						std::cout << "Error: --point-resolution requires a positive step size\n";
+						ret = -1;
+						goto end;
+					}
+				}
+				else if (compare(argv[i], "--simplify")) {
+					size_t errorpos;
+					if (++i >= argc || parseFloat(argv[i], options.simplifyTolerance, errorpos) != PARSE_OK || options.simplifyTolerance <= 0) {
+						std::cout << "Error: --simplify requires a positive tolerance in metres\n";
+						ret = -1;
+						goto end;
+					}
+				}
+				else if (compare(argv[i], "--geofence")) {
+					if (++i >= argc) {
+						std::cout << "Error: no geofence file specified\n";
+						ret = -1;
+						goto end;
+					}
+					std::string fencepath = fullpath(argv[i]);
+					std::string text, error;
+					if (!readFileToString(fencepath, text)) {
+						std::cout << "Error opening geofence: " << fencepath << "\n";
+						ret = -1;
+						goto end;
+					}
+					if (!geofence.parse(text, error)) {
+						std::cout << fencepath << error << "\n";
+						ret = -1;
+						goto end;
+					}
+					options.geofence = &geofence;
+				}
+				else if (compare(argv[i], "--geofence-warn")) {
+					options.fenceWarnings = true;
+				}
+				else if (compare(argv[i], "--cache-dir")) {
+					if (++i < argc) {
+						cachedir = argv[i];
+					}
+					else {
+						std::cout << "Error: no cache directory specified\n";
+						ret = -1;
+						goto end;
+					}
+				}
+				else if (compare(argv[i], "--cache-size")) {
+					// any int32 count of megabytes fits the uint64 byte limit
+					int32_t megabytes;
+					size_t errorpos;
+					if (++i >= argc || parseInt(argv[i], megabytes, 1, INT32_MAX, errorpos) != PARSE_OK) {
+						std::cout << "Error: --cache-size requires a size in megabytes\n";
+						ret = -1;
+						goto end;
+					}
+					cachesize = megabytes;
+				}
+				else if (compare(argv[i], "--outdir")) {
+					if (++i < argc) {
+						outdir = argv[i];
+						batch = true;
+					}
+					else {
+						std::cout << "Error: no output directory specified\n";
+						ret = -1;
+						goto end;
+					}
+				}
+				else if (compare(argv[i], "--manifest")) {
+					if (++i < argc) {
+						if (!readManifest(argv[i], inputs)) {
+							ret = -1;
+							goto end;
+						}
+						batch = true;
+					}
+					else {
+						std::cout << "Error: no manifest file specified\n";
+						ret = -1;
+						goto end;
+					}
+				}
+				else {
+					std::cout << "Error: unknown option " << argv[i] << "\n";
+					ret = -1;
+					goto end;
+				}
+			}
+			else {
+				if (compare(argv[i], "-o")) {
+					if (++i < argc) {
+						outputfile = argv[i];
+						outputgiven = true;
+					}
+					else {
+						std::cout << "Error: no output file specified\n";
+						ret = -1;
+						goto end;
+					}
+				}
+				else if (compare(argv[i], "-j")) {
+					if (++i < argc && (threads = atoi(argv[i])) > 0) {
+						batch = true;
+					}
+					else {
+						std::cout << "Error: -j requires a thread count\n";
+						ret = -1;
+						goto end;
+					}
+				}
+				else if (compare(argv[i], "-O")) {
+					options.optimize = true;
+				}
+				else if (compare(argv[i], "-c")) {
+					compileonly = true;
+				}
+				else if (compare(argv[i], "-h")) {
+					printHelp();
+					goto end;
+				}
+				else {
+					std::cout << "Error: unknown option " << argv[i] << "\n";
+					ret = -1;
+					goto end;
+				}
+			}
+			break;
+
+		default:
+			inputs.push_back(argv[i]);
+			break;
+		}
+
+		++i;
+	}
+
+	if (argc == 1) {
+		printHelp();
+		goto end;
+	}
+
+	if (inputs.empty()) {
+		std::cout << "Error: no input file specified\n";
+		ret = -1;
+		goto end;
+	}
+
+	if (listing || report || steps) {
+		if (inputs.size() > 1) {
+			std::cout << "Error: --disasm, --size-report and --step-report take one file\n";
+			ret = -1;
+		}
+		else if (!inspectfile(inputs[0], outputgiven ? outputfile : "", listing, report, steps)) ret = -1;
+		goto end;
+	}
+
+	// only assembling source is cached
+	if (!cachedir.empty() && (compileonly || linking)) {
+		std::cout << "Error: --cache-dir only caches assembled routes and cannot be used with -c or --link\n";
+		ret = -1;
+		goto end;
+	}
+
+	if (linking) {
+		if (compileonly || !outdir.empty()) {
+			std::cout << "Error: --link writes one route and cannot be used with -c or --outdir\n";
+			ret = -1;
+		}
+		else if (!linkfiles(inputs, outputfile, options, threads)) ret = -1;
+		goto end;
+	}
+
+	if (inputs.size() > 1) batch = true;
+	if (compileonly && !outputgiven) outputfile = std::filesystem::path(inputs[0]).stem().string() + ".rao";
+
+	if (!cachedir.empty() && !cache.open(cachedir, (uint64_t)cachesize << 20)) {
+		std::cout << "Error: could not open cache directory " << cachedir << "\n";
+		ret = -1;
+		goto end;
+	}
+
+	if (batch) {
+		if (outputgiven) {
+			std::cout << "Error: -o cannot be used with several inputs, use --outdir\n";
+			ret = -1;
+			goto end;
+		}
+		if (!assemblebatch(inputs, outdir, threads, options, compileonly, cachedir.empty() ? nullptr : &cache, showstats ? &stats : nullptr)) ret = -1;
+	}
+	else {
+		std::string log;
+		bool success;
+		if (compileonly) success = compilefile(inputs[0], outputfile, log);
+		else {
+			std::unique_ptr<ThreadPool> pool;
+			if (options.simplifyTolerance > 0) pool = std::make_unique<ThreadPool>(threads);
+			success = assemblefile(inputs[0], outputfile, options, cachedir.empty() ? nullptr : &cache, showstats ? &stats : nullptr,
+				pool.get(), log);
+		}
+		std::cout << log;
+		if (!success) ret = -1;
+	}
+
+	if (showstats) {
+		std::string report;
+		if (batch) report.append("total\n");
+		stats.format(report);
+		std::cout << report;
+	}
+
+	if (!cachedir.empty()) cache.trim();
+
+end:
+	if (ret != 0) std::cout << "Build failed\n";
+	return ret;
+}
+
+
+void printHelp() {
+#if defined(_WIN32) || defined(_WIN64)
+	std::cout << "Usage: routeasm.exe [-o outfile] [-O] [--jumps] [--point-resolution r] filename\n";
+	std::cout << "       routeasm.exe [-j threads] [--outdir dir] [--manifest file] filename...\n";
+	std::cout << "       either form also takes [--cache-dir dir] [--cache-size mb]\n";
+	std::cout << "       routeasm.exe -c [-o module.rao] filename, or with batch options\n";
+	std::cout << "       routeasm.exe --link [-o outfile] [-O] [--jumps] [--point-resolution r] module.rao...\n";
+	std::cout << "       the first two forms and --link also take [--unroll n] [--lla-to-ned] [--legs]\n";
+	std::cout << "           [--simplify m] [--geofence file] [--geofence-warn] [--step-budget n] [--reuse-slots]\n";
+	std::cout << "       routeasm.exe [--disasm] [--size-report] [--step-report] [-o listing] file.bin\n\n";
+#else
+	std::cout << "Usage: routeasm [-o outfile] [-O] [--jumps] [--point-resolution r] filename\n";
+	std::cout << "       routeasm [-j threads] [--outdir dir] [--manifest file] filename...\n";
+	std::cout << "       either form also takes [--cache-dir dir] [--cache-size mb]\n";
+	std::cout << "       routeasm -c [-o module.rao] filename, or with batch options\n";
+	std::cout << "       routeasm --link [-o outfile] [-O] [--jumps] [--point-resolution r] module.rao...\n";
+	std::cout << "       the first two forms and --link also take [--unroll n] [--lla-to-ned] [--legs]\n";
+	std::cout << "           [--simplify m] [--geofence file] [--geofence-warn] [--step-budget n] [--reuse-slots]\n";
+	std::cout << "       routeasm [--disasm] [--size-report] [--step-report] [-o listing] file.bin\n\n";
+#endif
+
+	std::cout << "-o outfile         define output file path\n";
+	std::cout << "-j threads         assemble files in parallel, default is one per core\n";
+	std::cout << "--outdir dir       batch output directory, outputs are named after inputs\n";
+	std::cout << "--manifest file    read input file list from file, one per line\n";
+	std::cout << "-O                 optimize, folding constants and removing dead code\n";
+	std::cout << "--unroll n         optimize and unroll constant FOR loops up to n instructions\n";
+	std::cout << "--point-resolution r\n";
+	std::cout << "                   encode waypoints in steps of r where within one step\n";
+	std::cout << "--jumps            encode resolved jump offsets on branch instructions\n";
+	std::cout << "--lla-to-ned       convert POINT_LLA to POINT north, east and down of .home_ll\n";
+	std::cout << "--legs             append a table of leg lengths, headings and turns\n";
+	std::cout << "--simplify m       leave out waypoints within m metres of the simplified route\n";
+	std::cout << "--geofence file    reject waypoints and legs outside the areas and altitudes in file\n";
+	std::cout << "--geofence-warn    report geofence breaches as warnings rather than errors\n";
+	std::cout << "--step-budget n    fail routes that can run over n instructions between waypoints\n";
+	std::cout << "--reuse-slots      share variable slots between variables never needed at once\n";
+	std::cout << "--cache-dir dir    reuse output of earlier builds stored in dir, not with -c or --link\n";
+	std::cout << "--cache-size mb    size the cache directory is trimmed to, default 256\n";
+	std::cout << "-c                 compile to object modules named after inputs, .rao\n";
+	std::cout << "--link             link object modules into one route\n";
+	std::cout << "--stats            print phase times and counts, in ROUTEASM_STATS builds\n";
+	std::cout << "--disasm           list an assembled file as source, to -o if given\n";
+	std::cout << "--size-report      print the bytes an assembled file uses by opcode and construct\n";
+	std::cout << "--step-report      print the most instructions an assembled file runs between\n";
+	std::cout << "                   waypoints, and how many times each loop can run\n";
+	std::cout << "-h (--help)        display this help screen\n";
+}
+
+#endif
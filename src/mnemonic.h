@@ -0,0 +1,317 @@
+// mnemonic lookup tables built at compile time from MNEMONIC_LIST
+
+#ifndef MNEMONIC_H
+#define MNEMONIC_H
+
+#include "routeasm.h"
+
+#include <array>
+#include <string_view>
+
+// operand kinds and their encoded sizes
+// VAR is a variable slot reference, DECL declares a new slot
+// Qn is a signed n bit count of point resolution steps
+enum OperandType : uint8_t {
+	OPERAND_NONE,
+	OPERAND_VAR,
+	OPERAND_DECL,
+	OPERAND_INT,
+	OPERAND_FLOAT,
+	OPERAND_Q8,
+	OPERAND_Q16,
+	OPERAND_Q24
+};
+
+constexpr INT_T operandSize(uint8_t type) {
+	switch (type) {
+	case OPERAND_VAR:
+	case OPERAND_DECL:
+	case OPERAND_Q8:
+		return 1;
+	case OPERAND_INT:
+	case OPERAND_Q16:
+		return 2;
+	case OPERAND_Q24:
+		return 3;
+	case OPERAND_FLOAT:
+		return 4;
+	default:
+		return 0;
+	}
+}
+
+// largest value of a Qn operand, the smallest is its negation - 1
+constexpr int32_t quantaMax(uint8_t type) {
+	return (int32_t)((1u << (8 * operandSize(type) - 1)) - 1);
+}
+
+struct Mnemonic {
+	std::string_view name;
+	uint8_t opcode;
+	uint8_t operands[3];
+	uint8_t count;
+	// encoded size including opcode
+	uint8_t size;
+};
+
+#define MNEMONIC_ENTRY(name, opcode, a, b, c) { name, opcode, \
+	{ OPERAND_##a, OPERAND_##b, OPERAND_##c }, \
+	(OPERAND_##a != OPERAND_NONE) + (OPERAND_##b != OPERAND_NONE) + (OPERAND_##c != OPERAND_NONE), \
+	1 + operandSize(OPERAND_##a) + operandSize(OPERAND_##b) + operandSize(OPERAND_##c) },
+
+constexpr Mnemonic mnemonics[] = { MNEMONIC_LIST(MNEMONIC_ENTRY) };
+constexpr INT_T mnemonicCount = sizeof(mnemonics) / sizeof(mnemonics[0]);
+
+#undef MNEMONIC_ENTRY
+
+
+// case insensitive FNV-1a, finished with a seeded mix
+// so the low bits used for the slot depend on every character
+constexpr uint32_t mnemonicHash(std::string_view token, uint32_t seed) {
+	uint32_t hash = 2166136261u;
+	for (char c : token) {
+		hash ^= (uint8_t)asciiLower(c);
+		hash *= 16777619u;
+	}
+	hash ^= seed * 0x9E3779B9u;
+	hash ^= hash >> 16;
+	hash *= 0x85EBCA6Bu;
+	hash ^= hash >> 13;
+	return hash;
+}
+
+// perfect hash table, every mnemonic has its own slot
+// so a lookup is one hash and one comparison
+constexpr UINT_T mnemonicTableSize = 128;
+
+// find the first seed that places every mnemonic in a separate slot
+constexpr uint32_t findMnemonicSeed() {
+	for (uint32_t seed = 0;; ++seed) {
+		bool used[mnemonicTableSize] = {};
+		bool perfect = true;
+		for (INT_T i = 0; i < mnemonicCount && perfect; ++i) {
+			UINT_T slot = mnemonicHash(mnemonics[i].name, seed) % mnemonicTableSize;
+			if (used[slot]) perfect = false;
+			used[slot] = true;
+		}
+		if (perfect) return seed;
+	}
+}
+
+constexpr uint32_t mnemonicSeed = findMnemonicSeed();
+
+// slot to mnemonic index, -1 for empty slots
+constexpr std::array<int8_t, mnemonicTableSize> buildMnemonicTable() {
+	std::array<int8_t, mnemonicTableSize> table = {};
+	for (auto& slot : table) slot = -1;
+	for (INT_T i = 0; i < mnemonicCount; ++i) {
+		table[mnemonicHash(mnemonics[i].name, mnemonicSeed) % mnemonicTableSize] = (int8_t)i;
+	}
+	return table;
+}
+
+constexpr std::array<int8_t, mnemonicTableSize> mnemonicTable = buildMnemonicTable();
+
+// opcode to mnemonic index for decoders, -1 for unused opcodes
+constexpr std::array<int8_t, 256> buildOpcodeTable() {
+	std::array<int8_t, 256> table = {};
+	for (auto& slot : table) slot = -1;
+	for (INT_T i = 0; i < mnemonicCount; ++i) {
+		if (table[mnemonics[i].opcode] < 0) table[mnemonics[i].opcode] = (int8_t)i;
+	}
+	return table;
+}
+
+constexpr std::array<int8_t, 256> opcodeTable = buildOpcodeTable();
+
+
+constexpr bool equalsLower(std::string_view token, std::string_view lower) {
+	if (token.size() != lower.size()) return false;
+	for (UINT_T i = 0; i < token.size(); ++i) {
+		if (asciiLower(token[i]) != lower[i]) return false;
+	}
+	return true;
+}
+
+// Look up a mnemonic token, case insensitive.
+// Returns nullptr for unknown tokens.
+constexpr const Mnemonic* findMnemonic(std::string_view token) {
+	INT_T index = mnemonicTable[mnemonicHash(token, mnemonicSeed) % mnemonicTableSize];
+	if (index < 0 || !equalsLower(token, mnemonics[index].name)) return nullptr;
+	return &mnemonics[index];
+}
+
+// Look up the mnemonic for an opcode.
+// Returns nullptr for unknown opcodes.
+constexpr const Mnemonic* findOpcode(uint8_t opcode) {
+	INT_T index = opcodeTable[opcode];
+	return index < 0 ? nullptr : &mnemonics[index];
+}
+
+// bytes after the operands when an opcode carries JUMP_FLAG,
+// -1 for opcodes that cannot
+constexpr INT_T jumpOperandSize(uint8_t opcode) {
+	switch (opcode) {
+	case WHILE_VAR:
+	case ENDWHILE:
+	case FOR:
+	case FOR_VAR:
+	case ENDFOR:
+	case IF_Z:
+	case IF_NZ:
+	case IF_POS:
+	case IF_NEG:
+		return 4;
+	case BREAK_WHILE:
+		return 5;
+	default:
+		return -1;
+	}
+}
+
+constexpr bool isBlockStart(uint8_t opcode) {
+	switch (opcode) {
+	case WHILE:
+	case WHILE_VAR:
+	case FOR:
+	case FOR_VAR:
+	case IF_Z:
+	case IF_NZ:
+	case IF_POS:
+	case IF_NEG:
+		return true;
+	default:
+		return false;
+	}
+}
+
+constexpr bool isBlockEnd(uint8_t opcode) {
+	return opcode == ENDWHILE || opcode == ENDFOR || opcode == ENDIF;
+}
+
+// slot an instruction writes, -1 if none
+constexpr INT_T writtenSlot(const RouteOp& op) {
+	switch (op.opcode) {
+	case INTEGER:
+	case INCREMENT:
+	case DECREMENT:
+	case ADD_ASSIGN:
+	case SUB_ASSIGN:
+	case MUL_ASSIGN:
+	case DIV_ASSIGN:
+	case ASSIGN:
+		return op.vars[0];
+	case ADD:
+	case SUB:
+	case MUL:
+	case DIV:
+		return op.vars[2];
+	default:
+		return -1;
+	}
+}
+
+// Size of the instruction starting with byte opcode,
+// -1 if it is not a valid opcode
+constexpr INT_T instructionSize(uint8_t opcode) {
+	if (opcode & JUMP_FLAG) {
+		const Mnemonic* mnemonic = findOpcode(opcode & ~JUMP_FLAG);
+		INT_T extra = jumpOperandSize(opcode & ~JUMP_FLAG);
+		return (mnemonic && extra >= 0) ? mnemonic->size + extra : -1;
+	}
+	const Mnemonic* mnemonic = findOpcode(opcode);
+	return mnemonic ? mnemonic->size : -1;
+}
+
+// write op without JUMP_FLAG to out, which must have room
+// for instructionSize(op.opcode) bytes
+inline void encodeOp(const RouteOp& op, uint8_t* out) {
+	const Mnemonic* mnemonic = findOpcode(op.opcode);
+	*out++ = op.opcode;
+	INT_T vars = 0, floats = 0;
+	for (INT_T i = 0; i < mnemonic->count; ++i) {
+		switch (mnemonic->operands[i]) {
+		case OPERAND_VAR:
+		case OPERAND_DECL:
+			*out = op.vars[vars++];
+			break;
+		case OPERAND_INT:
+			out[0] = (uint8_t)op.immediate;
+			out[1] = (uint8_t)(op.immediate >> 8);
+			break;
+		case OPERAND_FLOAT:
+			memcpy(out, &op.coords[floats++], 4);
+			break;
+		case OPERAND_Q8:
+		case OPERAND_Q16:
+		case OPERAND_Q24:
+			for (INT_T j = 0; j < operandSize(mnemonic->operands[i]); ++j) out[j] = (uint8_t)(op.quanta[i] >> (8 * j));
+			break;
+		}
+		out += operandSize(mnemonic->operands[i]);
+	}
+}
+
+// read an instruction written by encodeOp, in must start with a
+// valid opcode without JUMP_FLAG. op.line is left as it is
+inline void decodeOp(const uint8_t* in, RouteOp& op) {
+	const Mnemonic* mnemonic = findOpcode(*in);
+	INT_T line = op.line;
+	op = {};
+	op.line = line;
+	op.opcode = *in++;
+	INT_T vars = 0, floats = 0;
+	for (INT_T i = 0; i < mnemonic->count; ++i) {
+		uint8_t type = mnemonic->operands[i];
+		switch (type) {
+		case OPERAND_VAR:
+		case OPERAND_DECL:
+			op.vars[vars++] = *in;
+			break;
+		case OPERAND_INT:
+			op.immediate = (int16_t)(in[0] | in[1] << 8);
+			break;
+		case OPERAND_FLOAT:
+			memcpy(&op.coords[floats++], in, 4);
+			break;
+		case OPERAND_Q8:
+		case OPERAND_Q16:
+		case OPERAND_Q24: {
+			uint32_t raw = 0;
+			for (INT_T j = 0; j < operandSize(type); ++j) raw |= (uint32_t)in[j] << (8 * j);
+			// sign extend from the top byte
+			op.quanta[i] = (int32_t)(raw << (32 - 8 * operandSize(type))) >> (32 - 8 * operandSize(type));
+			break;
+		}
+		}
+		in += operandSize(type);
+	}
+}
+
+// true if data from at is a whole LEG_TABLE running to size
+inline bool validLegTable(const uint8_t* data, size_t size, size_t at) {
+	if (size - at < 5 || data[at] != LEG_TABLE) return false;
+	uint32_t count = (uint32_t)data[at + 1] | (uint32_t)data[at + 2] << 8 | (uint32_t)data[at + 3] << 16 | (uint32_t)data[at + 4] << 24;
+	return (size - at - 5) / LEG_SIZE == count && (size - at - 5) % LEG_SIZE == 0;
+}
+
+// bytes of the SLOT_COUNT data starts with, 0 if it has none and -1
+// if it is damaged. slots is set to its count, or to every slot
+inline INT_T readSlotCount(const uint8_t* data, size_t size, INT_T& slots) {
+	slots = SymbolTable::MAX_SYMBOLS;
+	if (size == 0 || data[0] != SLOT_COUNT) return 0;
+	if (size < SLOT_COUNT_SIZE) return -1;
+	slots = data[1] | data[2] << 8;
+	return slots <= SymbolTable::MAX_SYMBOLS ? SLOT_COUNT_SIZE : -1;
+}
+
+static_assert(findMnemonic("ADD_ASSIGN")->opcode == ADD_ASSIGN, "mnemonic table broken");
+static_assert(findMnemonic("dec")->opcode == DECREMENT, "mnemonic table broken");
+static_assert(findMnemonic("point_llama") == nullptr, "mnemonic table broken");
+static_assert(findOpcode(POINT_LLA)->size == 13, "mnemonic table broken");
+static_assert(instructionSize(FOR | JUMP_FLAG) == 7, "mnemonic table broken");
+static_assert(findOpcode(POINT_Q24)->size == 10 && findOpcode(POINT_D8)->size == 4, "mnemonic table broken");
+static_assert(instructionSize(LEG_TABLE) < 0, "LEG_TABLE is not an instruction");
+static_assert(instructionSize(SLOT_COUNT) < 0, "SLOT_COUNT is not an instruction");
+
+#endif
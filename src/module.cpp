@@ -0,0 +1,257 @@
+#include "module.h"
+#include "mnemonic.h"
+
+// module file:
+//  magic, path
+//  int32 home line, -1 without a home, then home latitude, longitude, altitude
+//  uint32 geo point count, then per point: latitude, longitude, altitude
+//  uint32 variable count, then per variable: uint8 kind, int32 line, name
+//  uint32 use count, then per use: name
+//  code
+//  uint32 fragment count, then per fragment: name, uint8 exported, int32 line, code
+// a name is a uint16 length and its bytes, code is a uint32
+// instruction count then per instruction an int32 line and the
+// instruction as encodeOp writes it, or USE_FRAGMENT and a uint16.
+// POINT_LLA is followed by a uint32 geo point index. Coordinates
+// are little endian doubles
+static const char MODULE_MAGIC[8] = { 'R', 'A', 'O', 'B', 'J', '0', '0', '2' };
+
+
+static void writeInt(std::vector<uint8_t>& out, uint32_t value, INT_T bytes) {
+	for (INT_T i = 0; i < bytes; ++i) out.push_back((uint8_t)(value >> (8 * i)));
+}
+
+
+static void writeDouble(std::vector<uint8_t>& out, double value) {
+	uint64_t bits;
+	memcpy(&bits, &value, 8);
+	writeInt(out, (uint32_t)bits, 4);
+	writeInt(out, (uint32_t)(bits >> 32), 4);
+}
+
+
+static void writeGeoPoint(std::vector<uint8_t>& out, const GeoPoint& point) {
+	writeDouble(out, point.latitude);
+	writeDouble(out, point.longitude);
+	writeDouble(out, point.altitude);
+}
+
+
+static void writeName(std::vector<uint8_t>& out, const std::string& name) {
+	writeInt(out, (uint32_t)name.size(), 2);
+	out.insert(out.end(), name.begin(), name.end());
+}
+
+
+static void writeCode(std::vector<uint8_t>& out, const std::vector<RouteOp>& code) {
+	writeInt(out, (uint32_t)code.size(), 4);
+	for (auto& op : code) {
+		writeInt(out, (uint32_t)op.line, 4);
+		if (op.opcode == USE_FRAGMENT) {
+			out.push_back(USE_FRAGMENT);
+			writeInt(out, (uint16_t)op.immediate, 2);
+			continue;
+		}
+		size_t at = out.size();
+		out.resize(at + instructionSize(op.opcode));
+		encodeOp(op, out.data() + at);
+		if (op.opcode == POINT_LLA) writeInt(out, (uint32_t)op.quanta[0], 4);
+	}
+}
+
+
+void writeModule(const ObjectModule& module, std::vector<uint8_t>& out) {
+	out.assign(MODULE_MAGIC, MODULE_MAGIC + sizeof(MODULE_MAGIC));
+	writeName(out, module.path);
+	writeInt(out, (uint32_t)module.homeLine, 4);
+	writeGeoPoint(out, module.home);
+	writeInt(out, (uint32_t)module.geoPoints.size(), 4);
+	for (auto& point : module.geoPoints) writeGeoPoint(out, point);
+	writeInt(out, (uint32_t)module.variables.size(), 4);
+	for (auto& variable : module.variables) {
+		out.push_back(variable.kind);
+		writeInt(out, (uint32_t)variable.line, 4);
+		writeName(out, variable.name);
+	}
+	writeInt(out, (uint32_t)module.uses.size(), 4);
+	for (auto& name : module.uses) writeName(out, name);
+	writeCode(out, module.code);
+	writeInt(out, (uint32_t)module.fragments.size(), 4);
+	for (auto& fragment : module.fragments) {
+		writeName(out, fragment.name);
+		out.push_back(fragment.exported);
+		writeInt(out, (uint32_t)fragment.line, 4);
+		writeCode(out, fragment.code);
+	}
+}
+
+
+// bounds checked reads, every read after one runs out gives 0
+struct ModuleReader {
+	const uint8_t* data;
+	size_t size;
+	size_t at = 0;
+	bool overrun = false;
+
+	bool has(size_t bytes) {
+		if (bytes > size - at) overrun = true;
+		return !overrun;
+	}
+	uint32_t read(INT_T bytes) {
+		if (!has(bytes)) return 0;
+		uint32_t value = 0;
+		for (INT_T i = 0; i < bytes; ++i) value |= (uint32_t)data[at++] << (8 * i);
+		return value;
+	}
+	double readDouble() {
+		uint64_t bits = read(4);
+		bits |= (uint64_t)read(4) << 32;
+		double value;
+		memcpy(&value, &bits, 8);
+		return value;
+	}
+	void readGeoPoint(GeoPoint& point) {
+		point.latitude = readDouble();
+		point.longitude = readDouble();
+		point.altitude = readDouble();
+		if (invalidCoordinate(point) >= 0) overrun = true;
+	}
+	void readName(std::string& name) {
+		size_t length = read(2);
+		if (!has(length)) return;
+		name.assign((const char*)data + at, length);
+		at += length;
+	}
+	// counts are checked against the bytes left so a bad one
+	// cannot make the reader allocate more than the file holds
+	uint32_t readCount(size_t smallest) {
+		uint32_t count = read(4);
+		if (!has((size_t)count * smallest)) return 0;
+		return count;
+	}
+};
+
+
+static bool readCode(ModuleReader& reader, std::vector<RouteOp>& code, std::string& error) {
+	uint32_t count = reader.readCount(5);
+	code.resize(count);
+	for (auto& op : code) {
+		op.line = (int32_t)reader.read(4);
+		if (!reader.has(1)) return false;
+		uint8_t opcode = reader.data[reader.at];
+		if (opcode == USE_FRAGMENT) {
+			++reader.at;
+			op.opcode = USE_FRAGMENT;
+			op.immediate = (int16_t)reader.read(2);
+			continue;
+		}
+		INT_T length = instructionSize(opcode);
+		if (length < 0 || (opcode & JUMP_FLAG)) {
+			char buffer[64];
+			snprintf(buffer, sizeof(buffer), "invalid opcode 0x%02x at offset %zu", opcode, reader.at);
+			error = buffer;
+			return false;
+		}
+		if (!reader.has(length)) return false;
+		decodeOp(reader.data + reader.at, op);
+		reader.at += length;
+		if (opcode == POINT_LLA) op.quanta[0] = (int32_t)reader.read(4);
+	}
+	return !reader.overrun;
+}
+
+
+bool readModule(const uint8_t* data, size_t size, ObjectModule& module, std::string& error) {
+	if (size < sizeof(MODULE_MAGIC) || memcmp(data, MODULE_MAGIC, sizeof(MODULE_MAGIC)) != 0) {
+		error = "not a route object module";
+		return false;
+	}
+	ModuleReader reader = { data, size, sizeof(MODULE_MAGIC) };
+	error.clear();
+
+	reader.readName(module.path);
+	module.homeLine = (int32_t)reader.read(4);
+	reader.readGeoPoint(module.home);
+	if (module.homeLine < 0) module.home = {};
+	module.geoPoints.resize(reader.readCount(24));
+	for (auto& point : module.geoPoints) reader.readGeoPoint(point);
+	module.variables.resize(reader.readCount(7));
+	for (auto& variable : module.variables) {
+		variable.kind = (SymbolKind)reader.read(1);
+		variable.line = (int32_t)reader.read(4);
+		reader.readName(variable.name);
+		if (variable.kind > SYMBOL_EXTERN) reader.overrun = true;
+	}
+	if (module.variables.size() > SymbolTable::MAX_SYMBOLS) reader.overrun = true;
+
+	module.uses.resize(reader.readCount(2));
+	for (auto& name : module.uses) reader.readName(name);
+
+	bool valid = !reader.overrun && readCode(reader, module.code, error);
+	module.fragments.resize(valid ? reader.readCount(11) : 0);
+	for (auto& fragment : module.fragments) {
+		reader.readName(fragment.name);
+		fragment.exported = reader.read(1) != 0;
+		fragment.line = (int32_t)reader.read(4);
+		if (!readCode(reader, fragment.code, error)) {
+			valid = false;
+			break;
+		}
+	}
+
+	// slots, use and geo point indexes and block nesting must be sound
+	// as linking trusts them, a fragment's blocks all close within it
+	auto check = [&](const std::vector<RouteOp>& code) {
+		std::vector<uint8_t> open;
+		for (auto& op : code) {
+			if (op.opcode == USE_FRAGMENT) {
+				if (op.immediate < 0 || op.immediate >= _INT(module.uses.size())) return false;
+				continue;
+			}
+			if (op.opcode == POINT_LLA && (uint32_t)op.quanta[0] >= module.geoPoints.size()) return false;
+			const Mnemonic* mnemonic = findOpcode(op.opcode);
+			INT_T vars = 0;
+			for (INT_T i = 0; i < mnemonic->count; ++i) {
+				uint8_t type = mnemonic->operands[i];
+				if ((type == OPERAND_VAR || type == OPERAND_DECL) && op.vars[vars++] >= module.variables.size()) return false;
+			}
+			switch (op.opcode) {
+			case WHILE:
+			case WHILE_VAR:
+			case FOR:
+			case FOR_VAR:
+			case IF_Z:
+			case IF_NZ:
+			case IF_POS:
+			case IF_NEG:
+				open.push_back(op.opcode);
+				break;
+			case ENDWHILE:
+				if (open.empty() || (open.back() != WHILE && open.back() != WHILE_VAR)) return false;
+				open.pop_back();
+				break;
+			case ENDFOR:
+				if (open.empty() || (open.back() != FOR && open.back() != FOR_VAR)) return false;
+				open.pop_back();
+				break;
+			case ENDIF:
+				if (open.empty() || open.back() < IF_Z || open.back() > IF_NEG) return false;
+				open.pop_back();
+				break;
+			case BREAK_WHILE: {
+				INT_T pops = 0;
+				INT_T i = open.size() - 1;
+				for (; i >= 0 && open[i] != WHILE && open[i] != WHILE_VAR; --i) pops += open[i] == FOR || open[i] == FOR_VAR;
+				if (i < 0 || pops > 255) return false;
+				break;
+			}
+			}
+		}
+		return open.empty();
+	};
+	valid = valid && !reader.overrun && reader.at == size && check(module.code);
+	for (size_t i = 0; valid && i < module.fragments.size(); ++i) valid = check(module.fragments[i].code);
+
+	if (!valid && error.empty()) error = "object module is damaged";
+	return valid;
+}
@@ -0,0 +1,63 @@
+// relocatable object modules, see Assembler::compile() and link()
+
+#ifndef MODULE_H
+#define MODULE_H
+
+#include "routeasm.h"
+
+// Stands in for the instructions of a fragment where .use inserts
+// it, immediate is the index of the fragment's name in uses. Only
+// found in modules, linking replaces it
+#define USE_FRAGMENT 0x00
+
+enum SymbolKind : uint8_t {
+	// seen only by its own module
+	SYMBOL_LOCAL,
+	// declared here and seen by every module that links with it
+	SYMBOL_GLOBAL,
+	// declared by another module
+	SYMBOL_EXTERN
+};
+
+struct ModuleVariable {
+	std::string name;
+	SymbolKind kind;
+	// line of the .global or .extern, -1 for locals
+	INT_T line;
+};
+
+struct ModuleFragment {
+	std::string name;
+	bool exported;
+	// line of the .fragment
+	INT_T line;
+	std::vector<RouteOp> code;
+};
+
+// A route parsed but not resolved: variable operands are slots into
+// variables and fragments are not yet inserted where they are used.
+// Linking gives every module's locals their own slots, gives each
+// global one slot shared by all modules and inserts fragments.
+struct ObjectModule {
+	// source the module was compiled from, for messages
+	std::string path;
+	// by slot
+	std::vector<ModuleVariable> variables;
+	// instructions outside any fragment, empty for a library
+	std::vector<RouteOp> code;
+	std::vector<ModuleFragment> fragments;
+	// fragment names used by USE_FRAGMENT
+	std::vector<std::string> uses;
+	// .home_ll, homeLine is -1 without one
+	GeoPoint home = {};
+	INT_T homeLine = -1;
+	// POINT_LLA operands in double precision, indexed by quanta[0]
+	std::vector<GeoPoint> geoPoints;
+};
+
+// module file: magic, then counts and records as little endian
+void writeModule(const ObjectModule& module, std::vector<uint8_t>& out);
+// false with error set if data is not a whole module
+bool readModule(const uint8_t* data, size_t size, ObjectModule& module, std::string& error);
+
+#endif
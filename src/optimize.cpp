@@ -0,0 +1,465 @@
+// optimizing passes over the instruction list, run before serializing
+//
+// Every pass keeps the block structure intact: blocks are only
+// removed whole, or have their start and end removed together,
+// so branch targets resolved later still match.
+
+#include "routeasm.h"
+#include "mnemonic.h"
+
+
+// index of the end of every block start, -1 for other instructions
+static std::vector<INT_T> matchBlocks(const std::vector<RouteOp>& code) {
+	std::vector<INT_T> match(code.size(), -1);
+	std::vector<INT_T> open;
+	for (INT_T i = 0; i < _INT(code.size()); ++i) {
+		if (isBlockStart(code[i].opcode)) open.push_back(i);
+		else if (isBlockEnd(code[i].opcode)) {
+			match[open.back()] = i;
+			open.pop_back();
+		}
+	}
+	return match;
+}
+
+
+// amount an instruction adds to its variable, false if it
+// does anything else
+static bool addend(const RouteOp& op, int32_t& amount) {
+	switch (op.opcode) {
+	case INCREMENT: amount = 1; return true;
+	case DECREMENT: amount = -1; return true;
+	case ADD_ASSIGN: amount = op.immediate; return true;
+	case SUB_ASSIGN: amount = -op.immediate; return true;
+	default: return false;
+	}
+}
+
+
+// drop instructions flagged in remove, returns true if any were
+static bool compact(std::vector<RouteOp>& code, const std::vector<uint8_t>& remove) {
+	size_t out = 0;
+	for (size_t i = 0; i < code.size(); ++i) {
+		if (!remove[i]) code[out++] = code[i];
+	}
+	bool changed = out != code.size();
+	code.resize(out);
+	return changed;
+}
+
+
+// Resolve FOR, FOR_VAR, IF_x and WHILE_VAR whose count or condition
+// is known. A variable is known after its INTEGER when that is its
+// only write and sits outside every block, so it runs exactly once
+// and before everything that follows it.
+static bool foldConstants(std::vector<RouteOp>& code) {
+	std::vector<INT_T> match = matchBlocks(code);
+
+	INT_T writes[256] = {};
+	INT_T definition[256];
+	for (auto& index : definition) index = -1;
+	INT_T depth = 0;
+	for (INT_T i = 0; i < _INT(code.size()); ++i) {
+		const RouteOp& op = code[i];
+		if (isBlockStart(op.opcode)) ++depth;
+		else if (isBlockEnd(op.opcode)) --depth;
+		INT_T slot = writtenSlot(op);
+		if (slot < 0) continue;
+		++writes[slot];
+		if (op.opcode == INTEGER && depth == 0) definition[slot] = i;
+	}
+
+	auto known = [&](uint8_t slot, INT_T at, int16_t& value) {
+		if (writes[slot] != 1 || definition[slot] < 0 || definition[slot] > at) return false;
+		value = code[definition[slot]].immediate;
+		return true;
+	};
+
+	std::vector<uint8_t> remove(code.size(), 0);
+	for (INT_T i = 0; i < _INT(code.size()); ++i) {
+		const RouteOp& op = code[i];
+		int16_t value;
+		// -1 block never runs, 1 block runs once, 0 unknown
+		INT_T outcome = 0;
+		switch (op.opcode) {
+		case FOR:
+			outcome = op.immediate <= 0 ? -1 : op.immediate == 1 ? 1 : 0;
+			break;
+		case FOR_VAR:
+			if (known(op.vars[0], i, value)) outcome = value <= 0 ? -1 : value == 1 ? 1 : 0;
+			break;
+		case WHILE_VAR:
+			if (known(op.vars[0], i, value) && value != 0) outcome = -1;
+			break;
+		case IF_Z:
+			if (known(op.vars[0], i, value)) outcome = value == 0 ? 1 : -1;
+			break;
+		case IF_NZ:
+			if (known(op.vars[0], i, value)) outcome = value != 0 ? 1 : -1;
+			break;
+		case IF_POS:
+			if (known(op.vars[0], i, value)) outcome = value > 0 ? 1 : -1;
+			break;
+		case IF_NEG:
+			if (known(op.vars[0], i, value)) outcome = value < 0 ? 1 : -1;
+			break;
+		}
+
+		if (outcome < 0) {
+			for (INT_T j = i; j <= match[i]; ++j) remove[j] = 1;
+			i = match[i];
+		}
+		else if (outcome > 0) {
+			remove[i] = 1;
+			remove[match[i]] = 1;
+		}
+	}
+
+	return compact(code, remove);
+}
+
+
+// Remove what follows END or BREAK_WHILE up to the end of the
+// enclosing block, then blocks left empty that do nothing.
+// Empty WHILE_VAR blocks are kept as they may never finish.
+static bool removeDeadCode(std::vector<RouteOp>& code) {
+	std::vector<uint8_t> remove(code.size(), 0);
+	for (INT_T i = 0; i < _INT(code.size()); ++i) {
+		if (code[i].opcode != END && code[i].opcode != BREAK_WHILE) continue;
+		INT_T depth = 0;
+		INT_T j = i + 1;
+		for (; j < _INT(code.size()); ++j) {
+			if (isBlockStart(code[j].opcode)) ++depth;
+			else if (isBlockEnd(code[j].opcode) && depth-- == 0) break;
+			remove[j] = 1;
+		}
+		i = j - 1;
+	}
+	bool changed = compact(code, remove);
+
+	// a start directly followed by an end is its own block
+	remove.assign(code.size(), 0);
+	for (INT_T i = 0; i + 1 < _INT(code.size()); ++i) {
+		uint8_t opcode = code[i].opcode;
+		if ((opcode == FOR || opcode == FOR_VAR || (opcode >= IF_Z && opcode <= IF_NEG)) && isBlockEnd(code[i + 1].opcode)) {
+			remove[i] = 1;
+			remove[i + 1] = 1;
+			++i;
+		}
+	}
+	return compact(code, remove) || changed;
+}
+
+
+// Copy the body of innermost FOR loops with a constant count in
+// place of the loop when the copies total at most limit instructions.
+static bool unrollLoops(std::vector<RouteOp>& code, INT_T limit) {
+	std::vector<INT_T> match = matchBlocks(code);
+	std::vector<RouteOp> out;
+	out.reserve(code.size());
+	bool changed = false;
+
+	for (INT_T i = 0; i < _INT(code.size()); ++i) {
+		const RouteOp& op = code[i];
+		if (op.opcode == FOR) {
+			INT_T body = match[i] - i - 1;
+			bool innermost = true;
+			for (INT_T j = i + 1; j < match[i]; ++j) {
+				if (code[j].opcode == FOR || code[j].opcode == FOR_VAR) innermost = false;
+			}
+			if (innermost && body > 0 && (int64_t)op.immediate * body <= limit) {
+				for (INT_T n = 0; n < op.immediate; ++n) {
+					out.insert(out.end(), code.begin() + i + 1, code.begin() + match[i]);
+				}
+				i = match[i];
+				changed = true;
+				continue;
+			}
+		}
+		out.push_back(op);
+	}
+
+	if (changed) code.swap(out);
+	return changed;
+}
+
+
+// Merge INCREMENT, DECREMENT, ADD_ASSIGN and SUB_ASSIGN in a row on
+// one variable into a single instruction, or none if they cancel.
+// Adjacent instructions are never split by a branch target as every
+// target is a block start, the instruction after one, or a block end.
+static bool foldRuns(std::vector<RouteOp>& code) {
+	size_t out = 0;
+	bool changed = false;
+	for (size_t i = 0; i < code.size(); ++i) {
+		int32_t amount, previous;
+		if (out > 0 && addend(code[i], amount) && addend(code[out - 1], previous) &&
+			code[i].vars[0] == code[out - 1].vars[0]) {
+			// arithmetic wraps at 16 bits so sums fold exactly
+			int16_t total = (int16_t)(amount + previous);
+			RouteOp& merged = code[out - 1];
+			if (total == 0) --out;
+			else if (total == 1) merged.opcode = INCREMENT;
+			else if (total == -1) merged.opcode = DECREMENT;
+			else {
+				merged.opcode = ADD_ASSIGN;
+				merged.immediate = total;
+			}
+			changed = true;
+			continue;
+		}
+		code[out++] = code[i];
+	}
+	code.resize(out);
+	return changed;
+}
+
+
+// Replace POINT_LLA by POINT in metres north, east and down of
+// home. The points are gathered into one array per coordinate and
+// converted in one call so the conversion runs vectorized.
+bool Assembler::convertPoints() {
+	STAT_TIME(stats, STAT_OPTIMIZE);
+	size_t count = 0;
+	for (auto& op : instructions) count += op.opcode == POINT_LLA;
+	if (count == 0) return true;
+	if (homeLine < 0) {
+		diagnostics.report(DIAG_NO_HOME, -1);
+		return false;
+	}
+
+	std::vector<double> buffer(count * 6);
+	double* latitude = buffer.data();
+	double* longitude = latitude + count;
+	double* altitude = longitude + count;
+	double* north = altitude + count;
+	double* east = north + count;
+	double* down = east + count;
+	size_t n = 0;
+	for (auto& op : instructions) {
+		if (op.opcode != POINT_LLA) continue;
+		const GeoPoint& point = geoPoints[op.quanta[0]];
+		latitude[n] = point.latitude;
+		longitude[n] = point.longitude;
+		altitude[n] = point.altitude;
+		++n;
+	}
+
+	llaToNed(nedFrame(home), latitude, longitude, altitude, count, north, east, down);
+
+	n = 0;
+	for (auto& op : instructions) {
+		if (op.opcode != POINT_LLA) continue;
+		op.opcode = POINT;
+		op.coords[0] = (float)north[n];
+		op.coords[1] = (float)east[n];
+		op.coords[2] = (float)down[n];
+		op.quanta[0] = 0;
+		++n;
+	}
+	return true;
+}
+
+
+void Assembler::optimize() {
+	STAT_TIME(stats, STAT_OPTIMIZE);
+	// each pass can expose more work for the others
+	for (INT_T round = 0; round < 16; ++round) {
+		bool changed = foldConstants(instructions);
+		changed |= removeDeadCode(instructions);
+		if (options.unrollLimit > 0) changed |= unrollLoops(instructions, options.unrollLimit);
+		changed |= foldRuns(instructions);
+		if (!changed) break;
+	}
+}
+
+
+// Replace POINT by POINT_Q24, or after another compact point in
+// the same straight run of code by POINT_D16 or POINT_D8, when
+// the nearest step lands within one step of the point. Step
+// positions are whole numbers so decoded points never drift.
+// A block start or end can be reached from elsewhere, so deltas
+// never reach across one. Routes that set their own resolution
+// are left alone.
+void Assembler::compactPoints() {
+	STAT_TIME(stats, STAT_OPTIMIZE);
+	for (auto& op : instructions) {
+		if (op.opcode == POINT_RESOLUTION) return;
+	}
+
+	float resolution = options.pointResolution;
+	int32_t position[3] = {};
+	bool based = false;
+	bool used = false;
+	for (auto& op : instructions) {
+		if (isBlockStart(op.opcode) || isBlockEnd(op.opcode) || op.opcode == POINT_Q24 ||
+			op.opcode == POINT_D16 || op.opcode == POINT_D8) {
+			based = false;
+			continue;
+		}
+		if (op.opcode != POINT) continue;
+		pointBytes += findOpcode(POINT)->size;
+
+		int32_t steps[3];
+		bool fits = true;
+		for (INT_T i = 0; i < 3 && fits; ++i) {
+			double nearest = std::nearbyint((double)op.coords[i] / resolution);
+			if (std::fabs(nearest) > quantaMax(OPERAND_Q24)) fits = false;
+			else {
+				steps[i] = (int32_t)nearest;
+				fits = std::fabs((float)steps[i] * resolution - op.coords[i]) <= resolution;
+			}
+		}
+		if (!fits) {
+			compactPointBytes += findOpcode(POINT)->size;
+			continue;
+		}
+
+		uint8_t opcode = POINT_Q24;
+		if (based) {
+			int32_t largest = 0;
+			for (INT_T i = 0; i < 3; ++i) {
+				int32_t delta = steps[i] - position[i];
+				// the negative range is one larger
+				int32_t magnitude = delta < 0 ? -delta - 1 : delta;
+				largest = MAX_2(largest, magnitude);
+			}
+			if (largest <= quantaMax(OPERAND_Q8)) opcode = POINT_D8;
+			else if (largest <= quantaMax(OPERAND_Q16)) opcode = POINT_D16;
+		}
+
+		op.opcode = opcode;
+		for (INT_T i = 0; i < 3; ++i) {
+			op.quanta[i] = opcode == POINT_Q24 ? steps[i] : steps[i] - position[i];
+			position[i] = steps[i];
+		}
+		based = true;
+		used = true;
+		compactPointBytes += findOpcode(opcode)->size;
+	}
+
+	if (used) {
+		RouteOp op = {};
+		op.opcode = POINT_RESOLUTION;
+		op.coords[0] = resolution;
+		op.line = instructions.front().line;
+		op.file = instructions.front().file;
+		instructions.insert(instructions.begin(), op);
+		compactPointBytes += findOpcode(POINT_RESOLUTION)->size;
+	}
+}
+
+
+// Waypoints whose positions are known, in route order. Compact
+// points are placed as the interpreter places them, and only where
+// their step position and resolution are known here. POINT_LLA is
+// placed from llaPositions, three per geo point, if it is set and
+// otherwise ends the run of waypoints before it like a flight mode
+// change. See RouteLeg for when waypoints are joined.
+void Assembler::traceWaypoints(std::vector<Waypoint>& waypoints, const std::vector<float>* llaPositions) const {
+	waypoints.clear();
+	float resolution = 1;
+	bool resolutionKnown = true;
+	int32_t position[3] = {};
+	bool positionKnown = false;
+	// false until a waypoint the next one is reached from
+	bool joined = false;
+	INT_T depth = 0;
+	for (INT_T i = 0; i < _INT(instructions.size()); ++i) {
+		const RouteOp& op = instructions[i];
+		Waypoint waypoint;
+		switch (op.opcode) {
+		case POINT:
+			for (INT_T j = 0; j < 3; ++j) waypoint.position[j] = op.coords[j];
+			break;
+
+		case POINT_RESOLUTION:
+			// one run in a block may or may not have happened
+			resolutionKnown = depth == 0;
+			resolution = op.coords[0];
+			continue;
+
+		case POINT_Q24:
+		case POINT_D16:
+		case POINT_D8:
+			for (INT_T j = 0; j < 3; ++j) {
+				position[j] = op.opcode == POINT_Q24 ? op.quanta[j] : (int32_t)((uint32_t)position[j] + (uint32_t)op.quanta[j]);
+				waypoint.position[j] = (float)position[j] * resolution;
+			}
+			positionKnown |= op.opcode == POINT_Q24;
+			if (!positionKnown || !resolutionKnown) {
+				joined = false;
+				continue;
+			}
+			break;
+
+		case POINT_LLA:
+			if (!llaPositions) {
+				joined = false;
+				continue;
+			}
+			for (INT_T j = 0; j < 3; ++j) waypoint.position[j] = (*llaPositions)[op.quanta[0] * 3 + j];
+			break;
+
+		case BREAK_WHILE:
+		case END:
+		case LAUNCH:
+		case LAND:
+		case RTL:
+			joined = false;
+			continue;
+
+		default:
+			if (isBlockStart(op.opcode) || isBlockEnd(op.opcode)) {
+				depth += isBlockStart(op.opcode) ? 1 : -1;
+				positionKnown = false;
+				joined = false;
+			}
+			continue;
+		}
+
+		waypoint.index = (uint32_t)i;
+		waypoint.joined = joined;
+		waypoints.push_back(waypoint);
+		joined = true;
+	}
+}
+
+
+// Work out the legs between waypoints that always follow each
+// other, see RouteLeg. Leg extents are gathered first so lengths
+// and headings come from one vectorized call.
+void Assembler::computeLegs() {
+	STAT_TIME(stats, STAT_OPTIMIZE);
+	legs.clear();
+	std::vector<Waypoint> waypoints;
+	traceWaypoints(waypoints, nullptr);
+
+	// extent of each leg
+	std::vector<double> north, east, down;
+	for (size_t i = 1; i < waypoints.size(); ++i) {
+		if (!waypoints[i].joined) continue;
+		const Waypoint& from = waypoints[i - 1];
+		const Waypoint& to = waypoints[i];
+		legs.push_back({ from.index, to.index, 0, 0, 0 });
+		north.push_back((double)to.position[0] - from.position[0]);
+		east.push_back((double)to.position[1] - from.position[1]);
+		down.push_back((double)to.position[2] - from.position[2]);
+	}
+	if (legs.empty()) return;
+
+	size_t count = legs.size();
+	std::vector<double> length(count), heading(count);
+	legGeometry(north.data(), east.data(), down.data(), count, length.data(), heading.data());
+
+	for (size_t i = 0; i < count; ++i) {
+		RouteLeg& leg = legs[i];
+		leg.length = (float)length[i];
+		leg.heading = (float)heading[i];
+		if (i == 0 || legs[i - 1].to != leg.from) continue;
+		double turn = heading[i] - heading[i - 1];
+		if (turn > 180) turn -= 360;
+		else if (turn <= -180) turn += 360;
+		leg.turn = (float)turn;
+	}
+}
@@ -1,1004 +1,721 @@
 #include "routeasm.h"
-
-
-#ifndef AUTOPILOT_INTERFACE
-void printHelp();
-bool assemblefile(std::string inputfile, std::string outputfile);
-#else
-bool assemblefile(std::string inputfile, std::string filestring, uint8_t*& dataptr, int& datasize);
-#endif
-//void showMessage(std::string filepath, const char* msg, INT_T line = -1);
-
+#include "mnemonic.h"
+#include "lexer.h"
+#include "module.h"
 
 #ifdef AUTOPILOT_INTERFACE
-std::string compileLog;
+#include "incremental.h"
 #endif
 
-float gnss_zerolat, gnss_zerolong;
-bool gnss_zero_defined;
 
-template <typename T1, typename T2>
-bool compare(T1 str1, T2 str2) {
-	return strcmp(str1, str2) == 0;
-}
+#ifdef AUTOPILOT_INTERFACE
+// log of the last routeasm() call made on this thread
+thread_local std::string compileLog;
 
 // AUTOPILOT_INTERFACE option compiles file differently if it is contained in program
-
-#ifndef AUTOPILOT_INTERFACE
-int main(int argc, char** argv) {
-	INT_T ret = 0;
-	std::string inputfile;
-	std::string outputfile = "a.bin";
-
-	INT_T i = 1;
-	while (i < argc) {
-		switch (*argv[i]) {
-		case '-':
-			if (*(argv[i] + 1) == '-') {
-				if (compare(argv[i], "--help")) {
-					printHelp();
-					goto end;
-				}
-			}
-			else {
-				if (compare(argv[i], "-o")) {
-					if (++i < argc) {
-						outputfile = argv[i];
-					}
-					else {
-						std::cout << "Error: no output file specified\n";
-						ret = -1;
-						goto end;
-					}
-				}
-				else if (compare(argv[i], "-h")) {
-					printHelp();
-					goto end;
-				}
-			}
-			break;
-
-		default:
-			inputfile = argv[i];
-			break;
-		}
-
-		++i;
-	}
-
-	if (argc == 1) {
-		printHelp();
-		goto end;
+bool routeasm(std::string inputfile, std::string filestring, uint8_t*& writeback, int& size) {
+	Assembler assembler;
+	bool success = assembler.assemble(inputfile, filestring);
+	compileLog.clear();
+	assembler.diagnostics.format(compileLog);
+	if (!success) {
+		compileLog.append("Build Failed");
+		return false;
 	}
+	compileLog.append("Build Succeeded");
 
-	if (inputfile.empty()) {
-		std::cout << "Error: no input file specified\n";
-		ret = -1;
-		goto end;
-	}
+	writeback = (uint8_t*)realloc(writeback, assembler.data.size());
+	size = assembler.data.size();
+	std::copy(assembler.data.begin(), assembler.data.end(), writeback);
+	return true;
+}
 
-	if (!assemblefile(inputfile, outputfile)) ret = -1;
 
-end:
-	if (ret != 0) std::cout << "Build failed\n";
-	return ret;
-}
-#else
-bool routeasm(std::string inputfile, std::string filestring, uint8_t*& writeback, int& size) {
-	compileLog.clear();
-	if (!assemblefile(inputfile, filestring, writeback, size)) {
+// bring writeback up to date with session after a load or edit
+static bool syncSession(IncrementalAssembler& session, bool success, uint8_t*& writeback, int& size) {
+	compileLog = session.log();
+	if (!success) {
 		compileLog.append("Build Failed");
 		return false;
 	}
 	compileLog.append("Build Succeeded");
+
+	const std::vector<uint8_t>& data = session.data();
+	if (size != _INT(data.size())) {
+		writeback = (uint8_t*)realloc(writeback, data.size());
+		size = data.size();
+	}
+	size_t from = MIN_2(session.changedFrom(), data.size());
+	std::copy(data.begin() + from, data.end(), writeback + from);
+	session.clearChanged();
 	return true;
 }
-#endif
 
 
-// Increment pointer to beyond whitespace
-inline void ptrws(const char*& strptr) {
-	while (*strptr == ' ' || *strptr == '\t') ++strptr;
+bool routeasm_load(IncrementalAssembler& session, std::string inputfile, std::string_view filestring, uint8_t*& writeback, int& size) {
+	bool success = session.assemble(std::move(inputfile), filestring);
+	return syncSession(session, success, writeback, size);
 }
 
-// Find next white space on character pointer
-inline void ptrnextws(const char*& strptr) {
-	//strptr = strchr(strptr, ' ');
-	strptr = strpbrk(strptr, " \t");
-}
 
-// Find next character value on pointer
-// increments past as many whitespace as required
-inline void ptrnextvalue(const char*& strptr) {
-	//strptr = strchr(strptr, ' ');
-	strptr = strpbrk(strptr, " \t");
-	while (*strptr == ' ' || *strptr == '\t') ++strptr;
+bool routeasm_edit(IncrementalAssembler& session, int firstline, int linecount, std::string_view text, uint8_t*& writeback, int& size) {
+	bool success = session.edit(firstline, linecount, text);
+	return syncSession(session, success, writeback, size);
 }
 
-// Increment pointer beyond selected character to remove
-inline void ptrrm(const char*& strptr, char rmchar) {
-	while (*strptr == rmchar) ++strptr;
-}
 
-// find next character value on pointer with selected
-// seperating value
-// only increments past one of the separating value
-inline void ptrnextvalue(const char*& strptr, char seperator) {
-	strptr = strchr(strptr, seperator);
-	++strptr;
+RouteasmResult routeasm_assemble(std::string_view inputpath, std::string_view source, std::span<uint8_t> output,
+	const AssemblerOptions& options, AssemblerStats* stats) {
+	STAT_ALLOCATIONS(stats);
+	// kept so repeated calls reuse its storage
+	thread_local Assembler assembler;
+	assembler.options = options;
+	assembler.stats = stats;
+
+	RouteasmResult result = { false, false, 0, &assembler.diagnostics };
+	if (!assembler.build(inputpath, source)) return result;
+	result.success = true;
+	result.size = assembler.serializedSize();
+	if (result.size <= output.size()) {
+		assembler.serialize(output.data());
+		result.written = true;
+	}
+	return result;
 }
+#endif
 
 
-void showMessage(std::string filepath, const char* msg, INT_T line = -1) {
-#ifndef AUTOPILOT_INTERFACE
-	if (line > -1) printf("%s(%d): %s\n", filepath.c_str(), line, msg);
-	else printf("%s: %s\n", filepath.c_str(), msg);
-#else
-	char buffer[256];
-	if (line > -1) sprintf(buffer, "%s(%d): %s\n", filepath.c_str(), line, msg);
-	else sprintf(buffer, "%s: %s\n", filepath.c_str(), msg);
-	compileLog.append(buffer);
-#endif
+void Assembler::numberError(ParseError error, std::string_view token, INT_T column, NumberKind kind) {
+	diagnostics.report(error == PARSE_RANGE ? DIAG_NUMBER_RANGE : DIAG_INVALID_NUMBER, linenumber, column, token, kind);
 }
 
 
-void unknown(std::string filepath, int line = -1) {
-#ifndef AUTOPILOT_INTERFACE
-	if (line > -1) printf("%s(%d): Error: Unknown command\n", filepath.c_str(), line);
-	else printf("%s: Error: Unknown command\n", filepath.c_str());
-#else
-	char buffer[256];
-	if (line > -1) sprintf(buffer, "%s(%d): Error: Unknown command\n", filepath.c_str(), line);
-	else sprintf(buffer, "%s: Error: Unknown command\n", filepath.c_str());
-	compileLog.append(buffer);
-#endif
+// keep the operands of a POINT_LLA in double precision for
+// converting, tokens are the operands as written
+bool Assembler::addGeoPoint(const Lexer& lexer, RouteOp& op, const std::string_view* tokens) {
+	GeoPoint point;
+	double* values[3] = { &point.latitude, &point.longitude, &point.altitude };
+	size_t errorpos;
+	// these parsed as floats, so parse as doubles too
+	for (INT_T i = 0; i < 3; ++i) parseFloat(tokens[i], *values[i], errorpos);
+	INT_T invalid = invalidCoordinate(point);
+	if (invalid >= 0) {
+		numberError(PARSE_RANGE, tokens[invalid], lexer.column(tokens[invalid]), NUMBER_FLOAT);
+		return false;
+	}
+	op.quanta[0] = (int32_t)geoPoints.size();
+	geoPoints.push_back(point);
+	return true;
 }
 
 
-// assembled data
-std::vector<uint8_t> data;
+// true if an end opcode closes a block started by start
+static bool closes(uint8_t end, uint8_t start) {
+	if (end == ENDWHILE) return start == WHILE || start == WHILE_VAR;
+	if (end == ENDFOR) return start == FOR || start == FOR_VAR;
+	return start >= IF_Z && start <= IF_NEG;
+}
 
-// array of integer names
-std::map<std::string, uint8_t> integers;
 
-// keep track of line number
-INT_T linenumber = 1;
+// check block nesting for an instruction as it is parsed
+bool Assembler::checkBlock(uint8_t opcode) {
+	switch (opcode) {
+	case WHILE:
+	case WHILE_VAR:
+	case FOR:
+	case FOR_VAR:
+	case IF_Z:
+	case IF_NZ:
+	case IF_POS:
+	case IF_NEG:
+		blocks.push_back({ opcode, linenumber });
+		return true;
 
-bool pushVarData(std::string name, std::string inputfile) {
-	auto it = integers.find(name);
-	if (it != integers.end()) {
-		data.push_back(integers[name]);
+	case ENDWHILE:
+	case ENDFOR:
+	case ENDIF: {
+		if (blocks.empty()) {
+			diagnostics.report(DIAG_UNMATCHED_END, linenumber, -1, {}, opcode);
+			return false;
+		}
+		Block& open = blocks.back();
+		if (!closes(opcode, open.opcode)) {
+			diagnostics.report(DIAG_MISMATCHED_END, linenumber, -1, {}, opcode, open.opcode, (int32_t)open.line);
+			// close back to a block this does end, so one missing
+			// end is reported once rather than at every later end
+			for (INT_T i = blocks.size() - 2; i >= 0; --i) {
+				if (closes(opcode, blocks[i].opcode)) {
+					blocks.resize(i);
+					break;
+				}
+			}
+			return false;
+		}
+		blocks.pop_back();
 		return true;
 	}
-	else {
-		char buffer[64];
-		sprintf(buffer, "Error: reference to undefined variable \"%s\"", name.c_str());
-		showMessage(inputfile, buffer, linenumber);
-		return false;
+
+	case BREAK_WHILE: {
+		INT_T i = blocks.size() - 1;
+		INT_T pops = 0;
+		for (; i >= 0; --i) {
+			if (blocks[i].opcode == WHILE || blocks[i].opcode == WHILE_VAR) break;
+			if (blocks[i].opcode == FOR || blocks[i].opcode == FOR_VAR) ++pops;
+		}
+		if (i < 0) {
+			diagnostics.report(DIAG_BREAK_OUTSIDE_WHILE, linenumber);
+			return false;
+		}
+		// the count is encoded in one byte, modules may be linked with jumps
+		if ((options.jumpOffsets || compiling) && pops > 255) {
+			diagnostics.report(DIAG_BREAK_TOO_DEEP, linenumber);
+			return false;
+		}
+		return true;
+	}
+
+	default:
+		return true;
 	}
 }
 
 
-#define radians(x) ((x) * 0.01745329251994329576923690768489)
-void gps_cartesian(float latitude, float longitude, float* x, float* y) {
-	float multiplier = 111194.9266;
+// checks once every line is read, end is true if there was an END
+void Assembler::checkFinished(bool end) {
+	if (!end) diagnostics.report(DIAG_NO_END, -1);
+	for (auto& block : blocks) diagnostics.report(DIAG_UNCLOSED_BLOCK, block.line, -1, {}, block.opcode);
+}
+
 
-	*x = (latitude - gnss_zerolat) * multiplier;
-	*y = (longitude - gnss_zerolong) * multiplier * cos(radians(latitude));
+static void writeWord(uint8_t* out, uint32_t value) {
+	for (INT_T i = 0; i < 4; ++i) out[i] = (uint8_t)(value >> (8 * i));
 }
 
 
-#ifndef AUTOPILOT_INTERFACE
-bool assemblefile(std::string inputfile, std::string outputfile) {
-#else
-bool assemblefile(std::string inputfile, std::string filestring, uint8_t * &dataptr, int& datasize) {
-#endif
-	gnss_zero_defined = false;
-	linenumber = 1;
-	//std::cout << inputfile << "\n";
-	//std::cout << outputfile << "\n";
-	data.clear();
-	integers.clear();
+// offset field at "at" holds the distance from byte "from" to byte "to"
+static void writeOffset(uint8_t* out, size_t at, size_t from, size_t to) {
+	writeWord(out + at, (uint32_t)((int64_t)to - (int64_t)from));
+}
 
-	namespace fs = std::filesystem;
-	fs::path currentpath = fs::current_path();
-#ifndef AUTOPILOT_INTERFACE
-	std::string inputpath = currentpath.string();
-	//#if defined(_WIN32) || defined(_WIN64)
-	//	inputpath.append("\\");
-	//#else
-
-	inputpath.append("/");
-	//#endif
-	inputpath.append(inputfile);
-#else
-	std::string inputpath = inputfile;
-#endif
-	std::replace(inputpath.begin(), inputpath.end(), '\\', '/');
 
-#ifndef AUTOPILOT_INTERFACE
-	std::string outputpath = currentpath.string();
-	outputpath.append("/");
-	outputpath.append(outputfile);
-	std::replace(outputpath.begin(), outputpath.end(), '\\', '/');
+static void writeFloat(uint8_t* out, float value) {
+	uint32_t bits;
+	memcpy(&bits, &value, 4);
+	writeWord(out, bits);
+}
 
-	//std::cout << inputpath << "\n";
-	//std::cout << outputpath << "\n";
 
-	std::string filestring;
-	if (!readFileToString(inputpath, filestring)) {
-		std::cout << "Error opening file: " << inputpath << "\n";
-		return false;
+size_t Assembler::serializedSize() const {
+	size_t total = options.reuseSlots ? SLOT_COUNT_SIZE : 0;
+	for (auto& op : instructions) total += instructionSize(op.opcode) + (options.jumpOffsets ? MAX_2(jumpOperandSize(op.opcode), 0) : 0);
+	if (options.legTable) total += 5 + legs.size() * LEG_SIZE;
+	return total;
+}
+
+
+// write instructions to out, resolving jump offsets if enabled
+void Assembler::serialize(uint8_t* out) const {
+	STAT_TIME(stats, STAT_ENCODE);
+	// open blocks, byte offsets
+	struct Open {
+		uint8_t opcode;
+		size_t start;
+		size_t body;
+		// BREAK_WHILE offset fields to patch and their instruction ends
+		std::vector<std::pair<size_t, size_t>> breaks;
+	};
+	std::vector<Open> open;
+	// instruction offsets for the leg table
+	std::vector<uint32_t> offsets;
+	if (options.legTable) offsets.reserve(instructions.size());
+
+	size_t end = 0;
+	if (options.reuseSlots) {
+		out[0] = SLOT_COUNT;
+		out[1] = (uint8_t)slotCount;
+		out[2] = (uint8_t)(slotCount >> 8);
+		end = SLOT_COUNT_SIZE;
 	}
-#endif
-	// insert newline at start of file
-	filestring.insert(0, "\n");
-	// add space at end of string
-	filestring.push_back(' ');
-	// make string lower case
-	transform(filestring.begin(), filestring.end(), filestring.begin(), ::tolower);
-	const char* lineptr = filestring.c_str();
-
-	// check if code after "END"
-	bool end = false;
-	INT_T endLength = 0;
-
-	// loop through lines of file
-	while (lineptr = strchr(lineptr, '\n')) {
-		++lineptr;
-		// remove whitespace at beginning of line
-		ptrws(lineptr);
-		// check if line is empty and continue if true
-		if (*lineptr == '\n') continue;
-
-		// switch first character of line
-		switch (*lineptr) {
-		case 'a':
-			if (strncmp(lineptr, "assign", 6) == 0) {
-				// record line end
-				const char* lineend = strchr(lineptr, '\n');
-				data.push_back(ASSIGN);
-				// get value 1
-				ptrnextvalue(lineptr);
-				// check name is given
-				if (lineptr >= lineend) {
-					showMessage(inputpath, "Error: identifiers requred for ASSIGN", linenumber);
-					return false;
-				}
-				// find size of integer name
-				INT_T size = strcspn(lineptr, " \n");
-				std::string name = std::string(lineptr, size);
-				if (!pushVarData(name, inputpath)) return false;
-
-				// get value 2
-				ptrnextvalue(lineptr);
-				// check name is given
-				if (lineptr >= lineend) {
-					showMessage(inputpath, "Error: only one identifier given for ASSIGN", linenumber);
-					return false;
-				}
-				// find size of integer name
-				size = strcspn(lineptr, " \n");
-				name = std::string(lineptr, size);
-				if (!pushVarData(name, inputpath)) return false;
-			}
-			else if (strncmp(lineptr, "add_assign", 10) == 0) {
-				// record line end
-				const char* lineend = strchr(lineptr, '\n');
-				data.push_back(ADD_ASSIGN);
-				// get value 1
-				ptrnextvalue(lineptr);
-				// check name is given
-				if (lineptr >= lineend) {
-					showMessage(inputpath, "Error: identifier requred for ADD_ASSIGN", linenumber);
-					return false;
-				}
-				// find size of integer name
-				INT_T size = strcspn(lineptr, " \n");
-				std::string name = std::string(lineptr, size);
-				if (!pushVarData(name, inputpath)) return false;
-
-				// get increment value
-				ptrnextvalue(lineptr);
-				// check value is given
-				if (lineptr >= lineend) {
-					showMessage(inputpath, "Error: no value given for ADD_ASSIGN", linenumber);
-					return false;
-				}
-				// record value
-				int16_t value = atoi(lineptr);
-				data.push_back((uint8_t)value);
-				data.push_back((uint8_t)(value >> 8));
-			}
-			else if (strncmp(lineptr, "add", 3) == 0 && (*(lineptr + 3) == '\n' || *(lineptr + 3) == '\0' || *(lineptr + 3) == ' ' || *(lineptr + 3) == ';')) {
-				// record line end
-				const char* lineend = strchr(lineptr, '\n');
-				data.push_back(ADD);
-				// get value 1
-				ptrnextvalue(lineptr);
-				// check name is given
-				if (lineptr >= lineend) {
-					showMessage(inputpath, "Error: identifiers requred for ADD", linenumber);
-					return false;
-				}
-				// find size of integer name
-				INT_T size = strcspn(lineptr, " \n");
-				std::string name = std::string(lineptr, size);
-				if (!pushVarData(name, inputpath)) return false;
-
-				// get value 2
-				ptrnextvalue(lineptr);
-				// check name is given
-				if (lineptr >= lineend) {
-					showMessage(inputpath, "Error: only one identifier given for ADD", linenumber);
-					return false;
-				}
-				// find size of integer name
-				size = strcspn(lineptr, " \n");
-				name = std::string(lineptr, size);
-				if (!pushVarData(name, inputpath)) return false;
-
-				// get value 3
-				ptrnextvalue(lineptr);
-				// check name is given
-				if (lineptr >= lineend) {
-					showMessage(inputpath, "Error: only two identifiers given for ADD", linenumber);
-					return false;
-				}
-				// find size of integer name
-				size = strcspn(lineptr, " \n");
-				name = std::string(lineptr, size);
-				if (!pushVarData(name, inputpath)) return false;
-			}
-			else {
-				unknown(inputpath, linenumber);
-				return false;
-			}
+	for (auto& op : instructions) {
+		bool jump = options.jumpOffsets && jumpOperandSize(op.opcode) >= 0;
+		size_t start = end;
+		if (options.legTable) offsets.push_back((uint32_t)start);
+
+		encodeOp(op, out + start);
+		end += instructionSize(op.opcode);
+		if (jump) out[start] |= JUMP_FLAG;
+		if (!options.jumpOffsets) continue;
+		if (jump) end += 4;
+
+		switch (op.opcode) {
+		case WHILE:
+		case WHILE_VAR:
+		case FOR:
+		case FOR_VAR:
+		case IF_Z:
+		case IF_NZ:
+		case IF_POS:
+		case IF_NEG:
+			open.push_back({ op.opcode, start, end, {} });
 			break;
 
-		case 'b':
-			if (strncmp(lineptr, "break_while", 11) == 0) data.push_back(BREAK_WHILE);
-			else {
-				unknown(inputpath, linenumber);
-				return false;
-			}
+		case ENDWHILE:
+		case ENDFOR:
+		case ENDIF: {
+			Open& block = open.back();
+			// ENDWHILE retests the condition, ENDFOR goes to the body
+			if (jump) writeOffset(out, end - 4, end, op.opcode == ENDWHILE ? block.start : block.body);
+			// skipping the block lands here
+			if (block.opcode != WHILE) writeOffset(out, block.body - 4, block.body, end);
+			for (auto& pending : block.breaks) writeOffset(out, pending.first, pending.second, end);
+			open.pop_back();
 			break;
+		}
 
-		case 'd':
-			if (strncmp(lineptr, "decrement", 9) == 0 || strncmp(lineptr, "dec", 3)) {
-				// record line end
-				const char* lineend = strchr(lineptr, '\n');
-				data.push_back(DECREMENT);
-				ptrnextvalue(lineptr);
-				// check name is given
-				if (lineptr >= lineend) {
-					showMessage(inputpath, "Error: identifier required for DECREMENT", linenumber);
-					return false;
-				}
-				// find size of integer name
-				INT_T size = strcspn(lineptr, " \n");
-				std::string name = std::string(lineptr, size);
-				//data.push_back(integers[name]);
-				if (!pushVarData(name, inputpath)) return false;
-			}
-			else if (strncmp(lineptr, "div_assign", 10) == 0) {
-				// record line end
-				const char* lineend = strchr(lineptr, '\n');
-				data.push_back(DIV_ASSIGN);
-				// get value 1
-				ptrnextvalue(lineptr);
-				// check name is given
-				if (lineptr >= lineend) {
-					showMessage(inputpath, "Error: identifier requred for DIV_ASSIGN", linenumber);
-					return false;
-				}
-				// find size of integer name
-				INT_T size = strcspn(lineptr, " \n");
-				std::string name = std::string(lineptr, size);
-				if (!pushVarData(name, inputpath)) return false;
-
-				// get increment value
-				ptrnextvalue(lineptr);
-				// check value is given
-				if (lineptr >= lineend) {
-					showMessage(inputpath, "Error: no value given for DIV_ASSIGN", linenumber);
-					return false;
-				}
-				// record value
-				int16_t value = atoi(lineptr);
-				data.push_back((uint8_t)value);
-				data.push_back((uint8_t)(value >> 8));
-			}
-			else if (strncmp(lineptr, "div", 3) == 0 && (*(lineptr + 3) == '\n' || *(lineptr + 3) == '\0' || *(lineptr + 3) == ' ' || *(lineptr + 3) == ';')) {
-				// record line end
-				const char* lineend = strchr(lineptr, '\n');
-				data.push_back(ADD);
-				// get value 1
-				ptrnextvalue(lineptr);
-				// check name is given
-				if (lineptr >= lineend) {
-					showMessage(inputpath, "Error: identifiers requred for DIV", linenumber);
-					return false;
-				}
-				// find size of integer name
-				INT_T size = strcspn(lineptr, " \n");
-				std::string name = std::string(lineptr, size);
-				if (!pushVarData(name, inputpath)) return false;
-
-				// get value 2
-				ptrnextvalue(lineptr);
-				// check name is given
-				if (lineptr >= lineend) {
-					showMessage(inputpath, "Error: only one identifier given for DIV", linenumber);
-					return false;
-				}
-				// find size of integer name
-				size = strcspn(lineptr, " \n");
-				name = std::string(lineptr, size);
-				if (!pushVarData(name, inputpath)) return false;
-
-				// get value 3
-				ptrnextvalue(lineptr);
-				// check name is given
-				if (lineptr >= lineend) {
-					showMessage(inputpath, "Error: only two identifiers given for DIV", linenumber);
-					return false;
-				}
-				// find size of integer name
-				size = strcspn(lineptr, " \n");
-				name = std::string(lineptr, size);
-				if (!pushVarData(name, inputpath)) return false;
-			}
-			else {
-				unknown(inputpath, linenumber);
-				return false;
+		case BREAK_WHILE: {
+			INT_T i = open.size() - 1;
+			INT_T pops = 0;
+			for (; open[i].opcode != WHILE && open[i].opcode != WHILE_VAR; --i) {
+				if (open[i].opcode == FOR || open[i].opcode == FOR_VAR) ++pops;
 			}
+			out[end++] = (uint8_t)pops;
+			open[i].breaks.push_back({ start + 1, end });
 			break;
+		}
+		}
+	}
 
-		case 'e':
-			if (strncmp(lineptr, "endwhile", 8) == 0) data.push_back(ENDWHILE);
-			else if (strncmp(lineptr, "endif", 5) == 0) data.push_back(ENDIF);
-			else if (strncmp(lineptr, "endfor", 6) == 0) data.push_back(ENDFOR);
-			else if (strncmp(lineptr, "end", 3) == 0 && (*(lineptr + 3) == '\n' || *(lineptr + 3) == '\0' || *(lineptr + 3) == ' ' || *(lineptr + 3) == ';')) {
-				data.push_back(END);
-				end = true;
-				endLength = data.size();
-			}
-			else {
-				unknown(inputpath, linenumber);
-				return false;
-			}
-			break;
+	if (!options.legTable) return;
+	out[end] = LEG_TABLE;
+	writeWord(out + end + 1, (uint32_t)legs.size());
+	uint8_t* record = out + end + 5;
+	for (auto& leg : legs) {
+		writeWord(record, offsets[leg.from]);
+		writeWord(record + 4, offsets[leg.to]);
+		writeFloat(record + 8, leg.length);
+		writeFloat(record + 12, leg.heading);
+		writeFloat(record + 16, leg.turn);
+		record += LEG_SIZE;
+	}
+}
 
-		case 'f':
-			if (strncmp(lineptr, "for_var", 7) == 0) {
-				// record line end
-				const char* lineend = strchr(lineptr, '\n');
-				data.push_back(FOR_VAR);
-				ptrnextvalue(lineptr);
-				// check name is given
-				if (lineptr >= lineend) {
-					showMessage(inputpath, "Error: identifier required for FOR_VAR", linenumber);
-					return false;
-				}
-				// find size of integer name
-				INT_T size = strcspn(lineptr, " ");
-				std::string name = std::string(lineptr, size);
-				if (!pushVarData(name, inputpath)) return false;
-			}
-			else if (strncmp(lineptr, "for", 3) == 0 && (*(lineptr + 3) == '\n' || *(lineptr + 3) == '\0' || *(lineptr + 3) == ' ' || *(lineptr + 3) == ';')) {
-				// record line end
-				const char* lineend = strchr(lineptr, '\n');
-				data.push_back(FOR);
-				ptrnextvalue(lineptr);
-				// check name is given
-				if (lineptr >= lineend) {
-					showMessage(inputpath, "Error: argument required for FOR", linenumber);
-					return false;
-				}
-				int16_t value = atoi(lineptr);
-				data.push_back((uint8_t)value);
-				data.push_back((uint8_t)(value >> 8));
-			}
-			else {
-				unknown(inputpath, linenumber);
-				return false;
-			}
+
+// read the operands of mnemonic from the rest of the lexer's line
+// into op, VAR and DECL names and FLOAT tokens are left in names by
+// operand position
+bool Assembler::parseLine(Lexer& lexer, const Mnemonic* mnemonic, RouteOp& op, std::string_view* names) {
+	op = {};
+	op.opcode = mnemonic->opcode;
+	op.line = linenumber;
+	INT_T floats = 0;
+	// read operands as listed for the mnemonic
+	for (INT_T i = 0; i < mnemonic->count; ++i) {
+		std::string_view operand = lexer.nextToken();
+		if (operand.empty()) {
+			diagnostics.report(DIAG_MISSING_OPERANDS, linenumber, -1, mnemonic->name, mnemonic->count, i);
+			return false;
+		}
+
+		switch (mnemonic->operands[i]) {
+		case OPERAND_VAR:
+		case OPERAND_DECL:
+			names[i] = operand;
 			break;
 
-		case 'i':
-			if (strncmp(lineptr, "if_z", 4) == 0) {
-				// record line end
-				const char* lineend = strchr(lineptr, '\n');
-				data.push_back(IF_Z);
-				ptrnextvalue(lineptr);
-				// check name is given
-				if (lineptr >= lineend) {
-					showMessage(inputpath, "Error: identifier required for IF_Z", linenumber);
-					return false;
-				}
-				// find size of integer name
-				INT_T size = strcspn(lineptr, " \n");
-				std::string name = std::string(lineptr, size);
-				if (!pushVarData(name, inputpath)) return false;
-			}
-			else if (strncmp(lineptr, "if_nz", 5) == 0) {
-				// record line end
-				const char* lineend = strchr(lineptr, '\n');
-				data.push_back(IF_NZ);
-				ptrnextvalue(lineptr);
-				// check name is given
-				if (lineptr >= lineend) {
-					showMessage(inputpath, "Error: identifier required for IF_NZ", linenumber);
-					return false;
-				}
-				// find size of integer name
-				INT_T size = strcspn(lineptr, " \n");
-				std::string name = std::string(lineptr, size);
-				if (!pushVarData(name, inputpath)) return false;
-			}
-			else if (strncmp(lineptr, "if_pos", 6) == 0) {
-				// record line end
-				const char* lineend = strchr(lineptr, '\n');
-				data.push_back(IF_POS);
-				ptrnextvalue(lineptr);
-				// check name is given
-				if (lineptr >= lineend) {
-					showMessage(inputpath, "Error: identifier required for IF_POS", linenumber);
-					return false;
-				}
-				// find size of integer name
-				INT_T size = strcspn(lineptr, " \n");
-				std::string name = std::string(lineptr, size);
-				if (!pushVarData(name, inputpath)) return false;
-			}
-			else if (strncmp(lineptr, "if_neg", 6) == 0) {
-				// record line end
-				const char* lineend = strchr(lineptr, '\n');
-				data.push_back(IF_Z);
-				ptrnextvalue(lineptr);
-				// check name is given
-				if (lineptr >= lineend) {
-					showMessage(inputpath, "Error: identifier required for IF_NEG", linenumber);
-					return false;
-				}
-				// find size of integer name
-				INT_T size = strcspn(lineptr, " \n");
-				std::string name = std::string(lineptr, size);
-				if (!pushVarData(name, inputpath)) return false;
-			}
-			else if (strncmp(lineptr, "integer", 8) == 0 || strncmp(lineptr, "int", 3) == 0) {
-				// record line end
-				const char* lineend = strchr(lineptr, '\n');
-				data.push_back(INTEGER);
-				ptrnextvalue(lineptr);
-				// check name is given
-				if (lineptr >= lineend) {
-					showMessage(inputpath, "Error: identifier required for INTEGER", linenumber);
-					return false;
-				}
-				// find size of integer name
-				INT_T size = strcspn(lineptr, " ");
-				std::string intname = std::string(lineptr, size);
-				INT_T index = integers.size();
-				integers[intname] = index;
-				data.push_back((uint8_t)index);
-
-				ptrnextvalue(lineptr);
-				// check value is given
-				if (lineptr >= lineend) {
-					showMessage(inputpath, "Error: no value given for INTEGER", linenumber);
-					return false;
-				}
-				// record value
-				int16_t value = atoi(lineptr);
-				data.push_back((uint8_t)value);
-				data.push_back((uint8_t)(value >> 8));
-			}
-			else if (strncmp(lineptr, "increment", 9) == 0 || strncmp(lineptr, "inc", 3)) {
-				// record line end
-				const char* lineend = strchr(lineptr, '\n');
-				data.push_back(INCREMENT);
-				ptrnextvalue(lineptr);
-				// check name is given
-				if (lineptr >= lineend) {
-					showMessage(inputpath, "Error: identifier required for INCREMENT", linenumber);
-					return false;
-				}
-				// find size of integer name
-				INT_T size = strcspn(lineptr, " \n");
-				std::string name = std::string(lineptr, size);
-				if (!pushVarData(name, inputpath)) return false;
-			}
-			else {
-				unknown(inputpath, linenumber);
+		case OPERAND_INT: {
+			size_t errorpos;
+			ParseError error = parseInt16(operand, op.immediate, errorpos);
+			if (error != PARSE_OK) {
+				numberError(error, operand, lexer.column(operand) + errorpos, NUMBER_INTEGER);
 				return false;
 			}
 			break;
+		}
 
-		case 'l':
-			if (strncmp(lineptr, "launch", 6) == 0) data.push_back(LAUNCH);
-			else if (strncmp(lineptr, "land", 4) == 0 && (*(lineptr + 4) == '\n' || *(lineptr + 4) == '\0' || *(lineptr + 4) == ' ' || *(lineptr + 4) == ';')) data.push_back(LAND);
-			else {
-				unknown(inputpath, linenumber);
+		case OPERAND_FLOAT: {
+			names[i] = operand;
+			size_t errorpos;
+			ParseError error = parseFloat(operand, op.coords[floats], errorpos);
+			if (error != PARSE_OK) {
+				numberError(error, operand, lexer.column(operand) + errorpos, NUMBER_FLOAT);
 				return false;
 			}
+			++floats;
 			break;
+		}
 
-		case 'm':
-			if (strncmp(lineptr, "mul_assign", 10) == 0) {
-				// record line end
-				const char* lineend = strchr(lineptr, '\n');
-				data.push_back(MUL_ASSIGN);
-				// get value 1
-				ptrnextvalue(lineptr);
-				// check name is given
-				if (lineptr >= lineend) {
-					showMessage(inputpath, "Error: identifier requred for MUL_ASSIGN", linenumber);
-					return false;
-				}
-				// find size of integer name
-				INT_T size = strcspn(lineptr, " \n");
-				std::string name = std::string(lineptr, size);
-				if (!pushVarData(name, inputpath)) return false;
-
-				// get increment value
-				ptrnextvalue(lineptr);
-				// check value is given
-				if (lineptr >= lineend) {
-					showMessage(inputpath, "Error: no value given for MUL_ASSIGN", linenumber);
-					return false;
-				}
-				// record value
-				int16_t value = atoi(lineptr);
-				data.push_back((uint8_t)value);
-				data.push_back((uint8_t)(value >> 8));
-			}
-			else if (strncmp(lineptr, "mul", 3) == 0 && (*(lineptr + 3) == '\n' || *(lineptr + 3) == '\0' || *(lineptr + 3) == ' ' || *(lineptr + 3) == ';')) {
-				// record line end
-				const char* lineend = strchr(lineptr, '\n');
-				data.push_back(MUL);
-				// get value 1
-				ptrnextvalue(lineptr);
-				// check name is given
-				if (lineptr >= lineend) {
-					showMessage(inputpath, "Error: identifiers requred for MUL", linenumber);
-					return false;
-				}
-				// find size of integer name
-				INT_T size = strcspn(lineptr, " \n");
-				std::string name = std::string(lineptr, size);
-				if (!pushVarData(name, inputpath)) return false;
-
-				// get value 2
-				ptrnextvalue(lineptr);
-				// check name is given
-				if (lineptr >= lineend) {
-					showMessage(inputpath, "Error: only one identifier given for MUL", linenumber);
-					return false;
-				}
-				// find size of integer name
-				size = strcspn(lineptr, " \n");
-				name = std::string(lineptr, size);
-				if (!pushVarData(name, inputpath)) return false;
-
-				// get value 3
-				ptrnextvalue(lineptr);
-				// check name is given
-				if (lineptr >= lineend) {
-					showMessage(inputpath, "Error: only two identifiers given for MUL", linenumber);
-					return false;
-				}
-				// find size of integer name
-				size = strcspn(lineptr, " \n");
-				name = std::string(lineptr, size);
-				if (!pushVarData(name, inputpath)) return false;
-			}
-			else {
-				unknown(inputpath, linenumber);
+		case OPERAND_Q8:
+		case OPERAND_Q16:
+		case OPERAND_Q24: {
+			size_t errorpos;
+			int32_t max = quantaMax(mnemonic->operands[i]);
+			ParseError error = parseInt(operand, op.quanta[i], -max - 1, max, errorpos);
+			if (error != PARSE_OK) {
+				numberError(error, operand, lexer.column(operand) + errorpos, NUMBER_STEPS);
 				return false;
 			}
 			break;
+		}
+		}
+	}
+	return true;
+}
 
-		case 'p':
-			if (strncmp(lineptr, "point_lla", 9) == 0) {
-				//if (!gnss_zero_defined) {
-				//	showMessage(inputpath, "Error: home position not defined, use .home_ll to define", linenumber);
-				//	return false;
-				//}
-				//// record line end
-				//const char* lineend = strchr(lineptr, '\n');
-				//// create type converter
-				//Float_Converter converter;
-				//// allocate memory
-				//data.reserve(13);
-				//data.push_back(POINT);
-				//// go to first value
-				//ptrnextvalue(lineptr);
-				//if (lineptr >= lineend) {
-				//	showMessage(inputpath, "Error: no arguments given for POINT_LLA, 3 required", linenumber);
-				//	return false;
-				//}
-				//float latitude = atof(lineptr);
-				//// next value
-				//ptrnextvalue(lineptr);
-				//if (lineptr >= lineend) {
-				//	showMessage(inputpath, "Error: one argument given for POINT_LLA, 3 required", linenumber);
-				//	return false;
-				//}
-				//float longitude = atof(lineptr);
-				//// next value
-				//ptrnextvalue(lineptr);
-				//if (lineptr >= lineend) {
-				//	showMessage(inputpath, "Error: two arguments given for POINT_LLA, 3 required", linenumber);
-				//	return false;
-				//}
-				//float altitude = atof(lineptr);
-
-				//float x, y;
-				//gps_cartesian(latitude, longitude, &x, &y);
-
-				//float coords[3] = { x, y, -altitude };
-				//for (int i = 0; i < 3; ++i) {
-				//	converter.value = coords[i];
-				//	for (int j = 0; j < 4; ++j) {
-				//		data.push_back(converter.reg[j]);
-				//	}
-				//}
-
-				// store end of line
-				const char* lineend = strchr(lineptr, '\n');
-				// create type converter
-				Float_Converter converter;
-				// allocate memory
-				data.reserve(13);
-				data.push_back(POINT_LLA);
-				// go to next value
-				for (INT_T i = 0; i < 3; ++i) {
-					ptrnextvalue(lineptr);
-					converter.value = atof(lineptr);
-					for (INT_T j = 0; j < 4; ++j) {
-						data.push_back(converter.reg[j]);
-					}
-				}
 
-				if (lineptr >= lineend) {
-					showMessage(inputpath, "Error: invalid arguments to mnemonic POINT_LLA", linenumber);
-					return false;
-				}
-			}
-			else if (strncmp(lineptr, "point", 5) == 0 && (*(lineptr + 5) == '\n' || *(lineptr + 5) == '\0' || *(lineptr + 5) == ' ' || *(lineptr + 5) == ';')) {
-				// store end of line
-				const char* lineend = strchr(lineptr, '\n');
-				// create type converter
-				Float_Converter converter;
-				// allocate memory
-				data.reserve(13);
-				data.push_back(POINT);
-				// go to next value
-				for (INT_T i = 0; i < 3; ++i) {
-					ptrnextvalue(lineptr);
-					converter.value = atof(lineptr);
-					for (INT_T j = 0; j < 4; ++j) {
-						data.push_back(converter.reg[j]);
-					}
-				}
+// look up VAR names and declare DECL names of a parsed line,
+// every name that fails is reported
+bool Assembler::resolveNames(const Lexer& lexer, RouteOp& op, const std::string_view* names) {
+	STAT_TIME(stats, STAT_SYMBOLS);
+	const Mnemonic* mnemonic = findOpcode(op.opcode);
+	INT_T vars = 0;
+	bool resolved = true;
+	for (INT_T i = 0; i < mnemonic->count; ++i) {
+		INT_T slot;
+		if (mnemonic->operands[i] == OPERAND_VAR) {
+			slot = integers.find(names[i]);
+			if (slot < 0) diagnostics.report(DIAG_UNDEFINED_VARIABLE, linenumber, lexer.column(names[i]), names[i]);
+		}
+		else if (mnemonic->operands[i] == OPERAND_DECL) {
+			slot = integers.declare(names[i]);
+			if (slot < 0) diagnostics.report(DIAG_TOO_MANY_VARIABLES, linenumber, lexer.column(names[i]), names[i]);
+		}
+		else continue;
+		if (slot < 0) resolved = false;
+		else op.vars[vars++] = (uint8_t)slot;
+	}
+	return resolved;
+}
 
-				if (lineptr >= lineend) {
-					showMessage(inputpath, "Error: invalid arguments to mnemonic POINT", linenumber);
-					return false;
-				}
-			}
-			else if (strncmp(lineptr, "print", 5) == 0) {
-				// record line end
-				const char* lineend = strchr(lineptr, '\n');
-				data.push_back(PRINT);
-				ptrnextvalue(lineptr);
-				// check name is given
-				if (lineptr >= lineend) {
-					showMessage(inputpath, "Error: identifier required for PRINT", linenumber);
-					return false;
-				}
-				// find size of integer name
-				INT_T size = strcspn(lineptr, " \n");
-				std::string name = std::string(lineptr, size);
-				if (!pushVarData(name, inputpath)) return false;
-			}
-			else {
-				unknown(inputpath, linenumber);
-				return false;
-			}
-			break;
 
-		case 'r':
-			if (strncmp(lineptr, "rtl", 3) == 0 && (*(lineptr + 3) == '\n' || *(lineptr + 3) == '\0' || *(lineptr + 3) == ' ' || *(lineptr + 3) == ';')) data.push_back(RTL);
-			else {
-				unknown(inputpath, linenumber);
-				return false;
-			}
-			break;
+bool Assembler::assemble(std::string_view inputpath, std::string_view source) {
+	data.clear();
+	if (!build(inputpath, source)) return false;
+	data.resize(serializedSize());
+	serialize(data.data());
+	return true;
+}
 
-		case 's':
-			if (strncmp(lineptr, "sub_assign", 10) == 0) {
-				// record line end
-				const char* lineend = strchr(lineptr, '\n');
-				data.push_back(SUB_ASSIGN);
-				// get value 1
-				ptrnextvalue(lineptr);
-				// check name is given
-				if (lineptr >= lineend) {
-					showMessage(inputpath, "Error: identifier requred for SUB_ASSIGN", linenumber);
-					return false;
-				}
-				// find size of integer name
-				INT_T size = strcspn(lineptr, " \n");
-				std::string name = std::string(lineptr, size);
-				if (!pushVarData(name, inputpath)) return false;
-
-				// get increment value
-				ptrnextvalue(lineptr);
-				// check value is given
-				if (lineptr >= lineend) {
-					showMessage(inputpath, "Error: no value given for SUB_ASSIGN", linenumber);
-					return false;
-				}
-				// record value
-				int16_t value = atoi(lineptr);
-				data.push_back((uint8_t)value);
-				data.push_back((uint8_t)(value >> 8));
-			}
-			else if (strncmp(lineptr, "sub", 3) == 0 && (*(lineptr + 3) == '\n' || *(lineptr + 3) == '\0' || *(lineptr + 3) == ' ' || *(lineptr + 3) == ';')) {
-				// record line end
-				const char* lineend = strchr(lineptr, '\n');
-				data.push_back(SUB);
-				// get value 1
-				ptrnextvalue(lineptr);
-				// check name is given
-				if (lineptr >= lineend) {
-					showMessage(inputpath, "Error: identifiers requred for SUB", linenumber);
-					return false;
-				}
-				// find size of integer name
-				INT_T size = strcspn(lineptr, " \n");
-				std::string name = std::string(lineptr, size);
-				if (!pushVarData(name, inputpath)) return false;
-
-				// get value 2
-				ptrnextvalue(lineptr);
-				// check name is given
-				if (lineptr >= lineend) {
-					showMessage(inputpath, "Error: only one identifier given for SUB", linenumber);
-					return false;
-				}
-				// find size of integer name
-				size = strcspn(lineptr, " \n");
-				name = std::string(lineptr, size);
-				if (!pushVarData(name, inputpath)) return false;
-
-				// get value 3
-				ptrnextvalue(lineptr);
-				// check name is given
-				if (lineptr >= lineend) {
-					showMessage(inputpath, "Error: only two identifiers given for SUB", linenumber);
-					return false;
-				}
-				// find size of integer name
-				size = strcspn(lineptr, " \n");
-				name = std::string(lineptr, size);
-				if (!pushVarData(name, inputpath)) return false;
-			}
-			else {
-				unknown(inputpath, linenumber);
-				return false;
-			}
-			break;
 
-		case 'w':
-			if (strncmp(lineptr, "while_var", 9) == 0) {
-				// record line end
-				const char* lineend = strchr(lineptr, '\n');
-				data.push_back(WHILE_VAR);
-				ptrnextvalue(lineptr);
-				// check name is given
-				if (lineptr >= lineend) {
-					showMessage(inputpath, "Error: identifier required for WHILE_VAR", linenumber);
-					return false;
-				}
-				// find size of integer name
-				INT_T size = strcspn(lineptr, " \n");
-				std::string name = std::string(lineptr, size);
-				if (!pushVarData(name, inputpath)) return false;
-			}
-			else if (strncmp(lineptr, "while", 5) == 0 && (*(lineptr + 5) == '\n' || *(lineptr + 5) == '\0' || *(lineptr + 5) == ' ' || *(lineptr + 5) == ';')) data.push_back(WHILE);
-			else {
-				unknown(inputpath, linenumber);
-				return false;
+bool Assembler::build(std::string_view inputpath, std::string_view source) {
+	reset(inputpath);
+	parseLines(source);
+	if (diagnostics.errors() > 0) return false;
+
+	if (!fragments.empty() || !uses.empty() || !externs.empty()) {
+		// resolve fragments and externs as a module linked on its own
+		std::vector<ObjectModule> modules(1);
+		makeModule(modules[0]);
+		diagnostics.files.assign(1, diagnostics.path);
+		if (!linkModules(modules)) return false;
+	}
+	return finish();
+}
+
+
+bool Assembler::compile(std::string_view inputpath, std::string_view source, ObjectModule& module) {
+	reset(inputpath);
+	compiling = true;
+	parseLines(source);
+	compiling = false;
+	if (diagnostics.errors() > 0) return false;
+	makeModule(module);
+	return true;
+}
+
+
+bool Assembler::link(std::string_view outputpath, const std::vector<ObjectModule>& modules) {
+	reset(outputpath);
+	for (auto& module : modules) diagnostics.files.push_back(module.path);
+	if (!linkModules(modules)) return false;
+	return finish();
+}
+
+
+void Assembler::reset(std::string_view inputpath) {
+	diagnostics.path.assign(inputpath);
+	diagnostics.clear();
+	diagnostics.fenceWarnings = options.fenceWarnings;
+	homeLine = -1;
+	geoPoints.clear();
+	instructions.clear();
+	integers.clear();
+	blocks.clear();
+	fragments.clear();
+	globals.clear();
+	externs.clear();
+	uses.clear();
+	openFragment = -1;
+	pointBytes = 0;
+	compactPointBytes = 0;
+	legs.clear();
+	removedPoints = 0;
+	maxDeviation = 0;
+	worstSteps = 0;
+	variableCount = 0;
+	slotCount = 0;
+}
+
+
+// passes over the finished instruction list
+bool Assembler::finish() {
+	if (options.llaToNed && !convertPoints()) return false;
+	if (options.optimize) optimize();
+	if (options.simplifyTolerance > 0) simplifyPoints();
+	if (options.geofence && !checkFence()) return false;
+	if (options.pointResolution > 0) compactPoints();
+	if (options.legTable) computeLegs();
+	if (options.stepBudget > 0 && !checkSteps()) return false;
+	if (options.reuseSlots) allocateSlots();
+
+#ifdef ROUTEASM_STATS
+	if (stats) {
+		for (auto& op : instructions) ++stats->instructions[op.opcode];
+		stats->symbolLookups += integers.lookups;
+		stats->symbolProbes += integers.probes;
+	}
+	integers.lookups = 0;
+	integers.probes = 0;
+#endif
+	return true;
+}
+
+
+// parse and check every line of source into instructions
+void Assembler::parseLines(std::string_view source) {
+	STAT_TIME(stats, STAT_PARSE);
+	Lexer lexer(source);
+
+	bool end = false;
+	// first line of code after the last "END", -1 if none
+	INT_T unreachableLine = -1;
+
+	// loop through lines of file, a line with an error is
+	// reported and left out and the rest are still checked
+	while (lexer.nextLine()) {
+		linenumber = lexer.line();
+		// skip empty and comment lines
+		std::string_view token = lexer.nextToken();
+		if (token.empty()) continue;
+		if (token[0] == '.') {
+			parseDirective(lexer, token);
+			continue;
+		}
+
+		// one table lookup per line
+		const Mnemonic* mnemonic = findMnemonic(token);
+		if (!mnemonic) {
+			diagnostics.report(DIAG_UNKNOWN_COMMAND, linenumber, lexer.column(token), token);
+			continue;
+		}
+
+		RouteOp op;
+		std::string_view names[3];
+		bool valid = parseLine(lexer, mnemonic, op, names);
+		if (valid) {
+			// fragments are not part of the route until used
+			bool route = openFragment < 0;
+			if (route && op.opcode == END) {
+				end = true;
+				unreachableLine = -1;
 			}
-			break;
+			else if (route && end && unreachableLine < 0) unreachableLine = linenumber;
+			valid = resolveNames(lexer, op, names);
+			if (op.opcode == POINT_LLA && (options.llaToNed || options.simplifyTolerance > 0 || options.geofence || compiling)) valid &= addGeoPoint(lexer, op, names);
+		}
 
-			//case '.':
-			//	if (strncmp(lineptr, ".home_ll", 7) == 0) {
-			//		// record line end
-			//		const char* lineend = strchr(lineptr, '\n');
-			//		ptrnextvalue(lineptr);
-			//		// check first value is given
-			//		if (lineptr >= lineend) {
-			//			showMessage(inputpath, "Error: no arguments given for \".home_ll\", two required", linenumber);
-			//			return false;
-			//		}
-			//		gnss_zerolat = atof(lineptr);
-			//		ptrnextvalue(lineptr);
-			//		// check second value is given
-			//		if (lineptr >= lineend) {
-			//			showMessage(inputpath, "Error: one argument given for \".home_ll\", two required", linenumber);
-			//			return false;
-			//		}
-			//		gnss_zerolong = atof(lineptr);
-			//		gnss_zero_defined = true;
-			//	}
-			//	else {
-			//		unknown(inputpath, linenumber);
-			//		return false;
-			//	}
-			//	break;
-
-		case ';':
-		case '\n':
-		case '\0':
-			++lineptr;
-			break;
+		// blocks are tracked for lines with bad operands too, so
+		// their block ends are not reported as well
+		if (checkBlock(mnemonic->opcode) && valid) (openFragment < 0 ? instructions : fragments[openFragment].code).push_back(op);
+	}
 
-		default:
-			unknown(inputpath, linenumber);
-			return false;
-			break;
+	if (openFragment >= 0) {
+		diagnostics.report(DIAG_UNCLOSED_FRAGMENT, fragments[openFragment].line, -1, fragments[openFragment].name);
+		openFragment = -1;
+	}
+	resolveGlobals();
+	// a module's END may be in another module
+	checkFinished(end || compiling);
+	if (unreachableLine >= 0) diagnostics.report(DIAG_UNREACHABLE, unreachableLine);
+}
+
+
+enum DirectiveKind {
+	DIRECTIVE_GLOBAL,
+	DIRECTIVE_EXTERN,
+	DIRECTIVE_FRAGMENT,
+	DIRECTIVE_ENDFRAGMENT,
+	DIRECTIVE_USE,
+	DIRECTIVE_HOME,
+	DIRECTIVE_UNKNOWN
+};
+
+
+static DirectiveKind findDirective(std::string_view token) {
+	static constexpr std::string_view names[] = { ".global", ".extern", ".fragment", ".endfragment", ".use", ".home_ll" };
+	INT_T kind = 0;
+	while (kind < DIRECTIVE_UNKNOWN && !equalsLower(token, names[kind])) ++kind;
+	return (DirectiveKind)kind;
+}
+
+
+static bool sameName(std::string_view a, std::string_view b) {
+	return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(), [](char x, char y) { return asciiLower(x) == asciiLower(y); });
+}
+
+
+// index of name in a list of directives or fragments, ignoring case
+template <typename T>
+static INT_T findNamed(const std::vector<T>& list, std::string_view name) {
+	for (INT_T i = 0; i < _INT(list.size()); ++i) {
+		if (sameName(list[i].name, name)) return i;
+	}
+	return -1;
+}
+
+
+// read a line starting with '.', see module.h
+void Assembler::parseDirective(Lexer& lexer, std::string_view directive) {
+	DirectiveKind kind = findDirective(directive);
+	if (kind == DIRECTIVE_UNKNOWN) {
+		diagnostics.report(DIAG_UNKNOWN_DIRECTIVE, linenumber, lexer.column(directive), directive);
+		return;
+	}
+
+	std::string_view name;
+	if (kind != DIRECTIVE_ENDFRAGMENT) {
+		name = lexer.nextToken();
+		if (name.empty()) {
+			diagnostics.report(DIAG_MISSING_OPERANDS, linenumber, -1, directive, kind == DIRECTIVE_HOME ? 2 : 1, 0);
+			return;
 		}
+	}
+	Directive named = { name, linenumber, name.empty() ? -1 : lexer.column(name) };
 
-		++linenumber;
+	switch (kind) {
+	case DIRECTIVE_GLOBAL:
+		// may come before the declaration, checked once parsed
+		globals.push_back(named);
+		break;
+
+	case DIRECTIVE_EXTERN: {
+		if (integers.find(name) >= 0) {
+			diagnostics.report(DIAG_DUPLICATE_SYMBOL, linenumber, named.column, name);
+			break;
+		}
+		if (integers.declare(name) < 0) {
+			diagnostics.report(DIAG_TOO_MANY_VARIABLES, linenumber, named.column, name);
+			break;
+		}
+		externs.push_back(named);
+		break;
 	}
 
-	// check end directive included in program
-	if (!end) {
-		showMessage(inputpath, "Error: no \"END\" mnemonic found");
-		return false;
+	case DIRECTIVE_FRAGMENT:
+		if (openFragment >= 0 || !blocks.empty()) {
+			diagnostics.report(DIAG_NESTED_FRAGMENT, linenumber, lexer.column(directive), directive);
+			break;
+		}
+		// parsed anyway so its lines are still checked
+		if (findNamed(fragments, name) >= 0) diagnostics.report(DIAG_DUPLICATE_SYMBOL, linenumber, named.column, name);
+		fragments.push_back({ name, linenumber, false, {} });
+		openFragment = fragments.size() - 1;
+		break;
+
+	case DIRECTIVE_ENDFRAGMENT:
+		if (openFragment < 0) {
+			diagnostics.report(DIAG_UNMATCHED_ENDFRAGMENT, linenumber, lexer.column(directive), directive);
+			break;
+		}
+		// blocks cannot run across the end of a fragment
+		for (auto& block : blocks) diagnostics.report(DIAG_UNCLOSED_BLOCK, block.line, -1, {}, block.opcode);
+		blocks.clear();
+		openFragment = -1;
+		break;
+
+	case DIRECTIVE_USE: {
+		INT_T index = 0;
+		while (index < _INT(uses.size()) && !sameName(uses[index], name)) ++index;
+		if (index == _INT(uses.size())) uses.push_back(name);
+		RouteOp op = {};
+		op.opcode = USE_FRAGMENT;
+		op.immediate = (int16_t)index;
+		op.line = linenumber;
+		(openFragment < 0 ? instructions : fragments[openFragment].code).push_back(op);
+		break;
 	}
 
-	if (endLength < data.size()) {
-		showMessage(inputpath, "Warning: unreachable code after \"END\" mnemonic");
+	case DIRECTIVE_HOME: {
+		// latitude, longitude and an optional altitude above the ellipsoid
+		std::string_view tokens[3] = { name, lexer.nextToken(), lexer.nextToken() };
+		if (tokens[1].empty()) {
+			diagnostics.report(DIAG_MISSING_OPERANDS, linenumber, -1, directive, 2, 1);
+			break;
+		}
+		GeoPoint point = {};
+		double* values[3] = { &point.latitude, &point.longitude, &point.altitude };
+		for (INT_T i = 0; i < 3 && !tokens[i].empty(); ++i) {
+			size_t errorpos;
+			ParseError error = parseFloat(tokens[i], *values[i], errorpos);
+			if (error != PARSE_OK) {
+				numberError(error, tokens[i], lexer.column(tokens[i]) + errorpos, NUMBER_FLOAT);
+				return;
+			}
+		}
+		INT_T invalid = invalidCoordinate(point);
+		if (invalid >= 0) {
+			numberError(PARSE_RANGE, tokens[invalid], lexer.column(tokens[invalid]), NUMBER_FLOAT);
+			break;
+		}
+		if (homeLine >= 0) {
+			diagnostics.report(DIAG_DUPLICATE_HOME, linenumber, lexer.column(directive), directive);
+			break;
+		}
+		home = point;
+		homeLine = linenumber;
+		break;
 	}
 
-	//for (auto it = data.begin(); it != data.end(); ++it) {
-	//	printf("%02X\n", *it);
-	//}
+	default:
+		break;
+	}
+}
 
-#ifndef AUTOPILOT_INTERFACE
-	uint8_t* dataptr = (uint8_t*)malloc(data.size());
-#else
-	dataptr = (uint8_t*)realloc(dataptr, data.size());
-	datasize = data.size();
-#endif
-	std::copy(data.begin(), data.end(), dataptr);
-#ifndef AUTOPILOT_INTERFACE
-	writeDataToFile(outputpath, dataptr, data.size());
-	free(dataptr);
-#endif
 
-	return true;
+// check every .global names a fragment or variable of this source
+void Assembler::resolveGlobals() {
+	for (auto& global : globals) {
+		INT_T fragment = findNamed(fragments, global.name);
+		if (fragment >= 0) fragments[fragment].exported = true;
+		INT_T slot = integers.find(global.name);
+		if (slot >= 0 && findNamed(externs, global.name) >= 0) diagnostics.report(DIAG_DUPLICATE_SYMBOL, global.line, global.column, global.name);
+		else if (slot < 0 && fragment < 0) diagnostics.report(DIAG_UNDEFINED_VARIABLE, global.line, global.column, global.name);
+	}
 }
 
 
-#ifndef AUTOPILOT_INTERFACE
-void printHelp() {
-#if defined(_WIN32) || defined(_WIN64)
-	std::cout << "Usage: routeasm.exe [-o outfile] filename\n\n";
-#else
-	std::cout << "Usage: routeasm [-o outfile] filename\n\n";
-#endif
+// move what was parsed into module, names are copied out of the source
+void Assembler::makeModule(ObjectModule& module) {
+	module.path = diagnostics.path;
+	module.variables.resize(integers.size());
+	for (INT_T slot = 0; slot < integers.size(); ++slot) module.variables[slot] = { std::string(integers.name(slot)), SYMBOL_LOCAL, -1 };
+	for (auto& external : externs) module.variables[integers.find(external.name)] = { std::string(external.name), SYMBOL_EXTERN, external.line };
+	for (auto& global : globals) {
+		INT_T slot = integers.find(global.name);
+		if (slot >= 0) module.variables[slot] = { std::string(integers.name(slot)), SYMBOL_GLOBAL, global.line };
+	}
 
-	std::cout << "-o outfile   define output file path\n";
-	std::cout << "-h (--help)  display this help screen\n";
+	module.code = std::move(instructions);
+	instructions.clear();
+	module.fragments.resize(fragments.size());
+	for (size_t i = 0; i < fragments.size(); ++i) {
+		module.fragments[i] = { std::string(fragments[i].name), fragments[i].exported, fragments[i].line, std::move(fragments[i].code) };
+	}
+	module.uses.assign(uses.begin(), uses.end());
+	module.home = home;
+	module.homeLine = homeLine;
+	module.geoPoints = std::move(geoPoints);
+	geoPoints.clear();
 }
-#endif
 
 
 #ifdef AUTOPILOT_INTERFACE
@@ -2,6 +2,17 @@
 #define ROUTEASM_H
 
 #include "util.h"
+#include "symtab.h"
+#include "diagnostics.h"
+#include "stats.h"
+#include "geodesy.h"
+
+#ifdef AUTOPILOT_INTERFACE
+#include <span>
+#endif
+
+// bump whenever output for the same source and options changes
+#define ROUTEASM_VERSION "1.9.0"
 
 #define POINT 0x01
 #define PRINT 0x02
@@ -34,10 +45,329 @@
 #define LAUNCH 0x23
 #define LAND 0x24
 #define RTL 0x25
+#define POINT_RESOLUTION 0x26
+#define POINT_Q24 0x27
+#define POINT_D16 0x28
+#define POINT_D8 0x29
+
+// Set on branch opcodes assembled with jump offsets. The
+// operands are followed by a little endian int32 offset from
+// the end of the instruction to its target:
+//  WHILE_VAR, FOR, FOR_VAR, IF_x  forward past the block end
+//  ENDWHILE                       back to the WHILE or WHILE_VAR
+//  ENDFOR                         back to the first body instruction
+//  BREAK_WHILE                    forward past ENDWHILE, then a byte
+//                                 giving the FOR loops it leaves
+#define JUMP_FLAG 0x80
+
+// Written after the route when AssemblerOptions::legTable is set
+// and never run, a decoder stops at it. Followed by a little endian
+// uint32 leg count, then LEG_SIZE bytes per leg: the byte offsets
+// of the waypoints it runs between as uint32, then as floats its
+// length in metres, heading in degrees clockwise from north and
+// the turn onto it at its first waypoint in degrees, positive to
+// the right, 0 if the leg before it is not known
+#define LEG_TABLE 0x2A
+#define LEG_SIZE 20
+
+// Written before the route when AssemblerOptions::reuseSlots is set
+// and never run, a decoder skips it. Followed by a little endian
+// uint16 count of the variable slots the route uses, every VAR and
+// DECL operand is below it
+#define SLOT_COUNT 0x2B
+#define SLOT_COUNT_SIZE 3
+
+// Compact waypoints count in steps of the resolution set by
+// POINT_RESOLUTION, 1 until one runs. POINT_Q24 sets the
+// current step position, POINT_D16 and POINT_D8 add to it,
+// and each goes to position * resolution.
+
+// mnemonic list, aliases share an opcode and the first
+// entry for an opcode is its name when decoding
+// X(name, opcode, operand1, operand2, operand3)
+#define MNEMONIC_LIST(X) \
+	X("point",       POINT,       FLOAT, FLOAT, FLOAT) \
+	X("print",       PRINT,       VAR,   NONE,  NONE)  \
+	X("while",       WHILE,       NONE,  NONE,  NONE)  \
+	X("while_var",   WHILE_VAR,   VAR,   NONE,  NONE)  \
+	X("endwhile",    ENDWHILE,    NONE,  NONE,  NONE)  \
+	X("for",         FOR,         INT,   NONE,  NONE)  \
+	X("endfor",      ENDFOR,      NONE,  NONE,  NONE)  \
+	X("integer",     INTEGER,     DECL,  INT,   NONE)  \
+	X("int",         INTEGER,     DECL,  INT,   NONE)  \
+	X("increment",   INCREMENT,   VAR,   NONE,  NONE)  \
+	X("inc",         INCREMENT,   VAR,   NONE,  NONE)  \
+	X("decrement",   DECREMENT,   VAR,   NONE,  NONE)  \
+	X("dec",         DECREMENT,   VAR,   NONE,  NONE)  \
+	X("add",         ADD,         VAR,   VAR,   VAR)   \
+	X("add_assign",  ADD_ASSIGN,  VAR,   INT,   NONE)  \
+	X("assign",      ASSIGN,      VAR,   VAR,   NONE)  \
+	X("sub",         SUB,         VAR,   VAR,   VAR)   \
+	X("sub_assign",  SUB_ASSIGN,  VAR,   INT,   NONE)  \
+	X("mul",         MUL,         VAR,   VAR,   VAR)   \
+	X("mul_assign",  MUL_ASSIGN,  VAR,   INT,   NONE)  \
+	X("div",         DIV,         VAR,   VAR,   VAR)   \
+	X("div_assign",  DIV_ASSIGN,  VAR,   INT,   NONE)  \
+	X("for_var",     FOR_VAR,     VAR,   NONE,  NONE)  \
+	X("if_z",        IF_Z,        VAR,   NONE,  NONE)  \
+	X("if_nz",       IF_NZ,       VAR,   NONE,  NONE)  \
+	X("if_pos",      IF_POS,      VAR,   NONE,  NONE)  \
+	X("if_neg",      IF_NEG,      VAR,   NONE,  NONE)  \
+	X("endif",       ENDIF,       NONE,  NONE,  NONE)  \
+	X("break_while", BREAK_WHILE, NONE,  NONE,  NONE)  \
+	X("end",         END,         NONE,  NONE,  NONE)  \
+	X("point_lla",   POINT_LLA,   FLOAT, FLOAT, FLOAT) \
+	X("launch",      LAUNCH,      NONE,  NONE,  NONE)  \
+	X("land",        LAND,        NONE,  NONE,  NONE)  \
+	X("rtl",         RTL,         NONE,  NONE,  NONE)  \
+	X("point_resolution", POINT_RESOLUTION, FLOAT, NONE, NONE) \
+	X("point_q24",   POINT_Q24,   Q24,   Q24,   Q24)   \
+	X("point_d16",   POINT_D16,   Q16,   Q16,   Q16)   \
+	X("point_d8",    POINT_D8,    Q8,    Q8,    Q8)
+
+class Geofence;
+class Lexer;
+class ThreadPool;
+struct Mnemonic;
+struct ObjectModule;
+
+struct AssemblerOptions {
+	// emit resolved branch offsets, see JUMP_FLAG
+	bool jumpOffsets = false;
+	// run the optimizing pass before serializing
+	bool optimize = false;
+	// with optimize, unroll constant FOR loops whose unrolled
+	// body is at most this many instructions, 0 disables
+	INT_T unrollLimit = 0;
+	// encode POINT with compact opcodes in steps of this size
+	// where that is within one step, 0 keeps every POINT raw
+	float pointResolution = 0;
+	// convert POINT_LLA to POINT in metres north, east and down of
+	// the home set by .home_ll
+	bool llaToNed = false;
+	// append a LEG_TABLE of the legs between waypoints
+	bool legTable = false;
+	// leave out waypoints of runs of POINT, or of POINT_LLA, that are
+	// within this many metres of the line through the waypoints kept,
+	// 0 keeps them all
+	float simplifyTolerance = 0;
+	// report waypoints outside this fence, and legs that leave it,
+	// as errors, or as warnings with fenceWarnings. Not owned, it
+	// must outlive assembling
+	const Geofence* geofence = nullptr;
+	bool fenceWarnings = false;
+	// fail routes that can run more than this many instructions
+	// between waypoints or flight mode changes, see StepReport. 0
+	// checks nothing
+	INT_T stepBudget = 0;
+	// give variables whose values are never needed at the same time
+	// one slot, and write a SLOT_COUNT before the route
+	bool reuseSlots = false;
+};
+
+// one instruction between parsing and serializing
+struct RouteOp {
+	uint8_t opcode;
+	// VAR and DECL operands in order
+	uint8_t vars[3];
+	// INT operand
+	int16_t immediate;
+	// source the line is in, as Diagnostic::file. Set by linking
+	uint16_t file;
+	// FLOAT operands in order
+	float coords[3];
+	// Q8, Q16 and Q24 operands in order
+	int32_t quanta[3];
+	// source line
+	INT_T line;
+};
+
+// A straight line between two waypoints where the route always
+// goes from one to the other: consecutive POINT or compact points
+// with no block start or end, BREAK_WHILE, flight mode change or
+// POINT_LLA between them
+struct RouteLeg {
+	// instruction indexes of the waypoints at each end
+	uint32_t from;
+	uint32_t to;
+	// as written in LEG_TABLE
+	float length;
+	float heading;
+	float turn;
+};
+
+// Assembler context
+// holds all state for assembling one route, separate
+// instances share nothing so may be used on different threads
+class Assembler {
+public:
+	// assemble route source text into data, inputpath is only used in
+	// messages. source is only read during the call and is never copied
+	bool assemble(std::string_view inputpath, std::string_view source);
+	// as assemble() but stop at instructions, leaving data as it is
+	bool build(std::string_view inputpath, std::string_view source);
+	// bytes serialize() writes for instructions
+	size_t serializedSize() const;
+	// write instructions to out, which must hold serializedSize() bytes
+	void serialize(uint8_t* out) const;
+	// parse source into a module for link() without resolving what
+	// it shares with other modules. Options only apply when linking
+	bool compile(std::string_view inputpath, std::string_view source, ObjectModule& module);
+	// resolve modules against each other into instructions as build()
+	// does for one source, outputpath names the result in messages
+	bool link(std::string_view outputpath, const std::vector<ObjectModule>& modules);
+
+	AssemblerOptions options;
+
+	// instructions data was serialized from
+	std::vector<RouteOp> instructions;
+	// assembled data
+	std::vector<uint8_t> data;
+	// errors and warnings from the last assembly, every line is
+	// checked so all of them are reported in one pass
+	Diagnostics diagnostics;
+	// bytes of POINT instructions before and after compact encoding
+	size_t pointBytes = 0;
+	size_t compactPointBytes = 0;
+	// legs written in LEG_TABLE with options.legTable
+	std::vector<RouteLeg> legs;
+	// waypoints options.simplifyTolerance left out, and the farthest
+	// any of them is from the route
+	size_t removedPoints = 0;
+	double maxDeviation = 0;
+	// most instructions run between events, with options.stepBudget
+	int64_t worstSteps = 0;
+	// slots used before and after options.reuseSlots
+	INT_T variableCount = 0;
+	INT_T slotCount = 0;
+	// phase times and counts are added here if set, in
+	// ROUTEASM_STATS builds
+	AssemblerStats* stats = nullptr;
+	// long waypoint runs are simplified on this if set. It must be a
+	// pool of its own, the assembler waits for every task in it
+	ThreadPool* pool = nullptr;
+
+private:
+	friend class IncrementalAssembler;
+
+	void reset(std::string_view inputpath);
+	bool finish();
+	void parseLines(std::string_view source);
+	void parseDirective(Lexer& lexer, std::string_view directive);
+	void resolveGlobals();
+	void makeModule(ObjectModule& module);
+	// link.cpp
+	bool linkModules(const std::vector<ObjectModule>& modules);
+	bool parseLine(Lexer& lexer, const Mnemonic* mnemonic, RouteOp& op, std::string_view* names);
+	bool resolveNames(const Lexer& lexer, RouteOp& op, const std::string_view* names);
+	void numberError(ParseError error, std::string_view token, INT_T column, NumberKind kind);
+	bool addGeoPoint(const Lexer& lexer, RouteOp& op, const std::string_view* tokens);
+	bool checkBlock(uint8_t opcode);
+	void checkFinished(bool end);
+	// a waypoint placed by traceWaypoints()
+	struct Waypoint {
+		// instruction index
+		uint32_t index;
+		float position[3];
+		// the route always comes straight from the waypoint before
+		bool joined;
+	};
+	// optimize.cpp
+	bool convertPoints();
+	void optimize();
+	void compactPoints();
+	void traceWaypoints(std::vector<Waypoint>& waypoints, const std::vector<float>* llaPositions) const;
+	void computeLegs();
+	// simplify.cpp
+	void simplifyPoints();
+	// geofence.cpp
+	bool checkFence();
+	// steps.cpp
+	bool checkSteps();
+	// slots.cpp
+	void allocateSlots();
+
+
+	// integer names to slots, names are views into the source
+	SymbolTable integers;
+	// keep track of line number
+	INT_T linenumber = 1;
+
+	// open WHILE, FOR and IF blocks while parsing
+	struct Block {
+		uint8_t opcode;
+		INT_T line;
+	};
+	std::vector<Block> blocks;
+
+	// directives, names are views into the source
+	struct Fragment {
+		std::string_view name;
+		INT_T line;
+		bool exported;
+		std::vector<RouteOp> code;
+	};
+	struct Directive {
+		std::string_view name;
+		INT_T line;
+		INT_T column;
+	};
+	std::vector<Fragment> fragments;
+	std::vector<Directive> globals;
+	std::vector<Directive> externs;
+	// fragment names used, USE_FRAGMENT operands index this
+	std::vector<std::string_view> uses;
+	// fragment being parsed, -1 outside fragments
+	INT_T openFragment = -1;
+	// set by compile(), the route is finished by linking
+	bool compiling = false;
+
+	// set by .home_ll, homeLine is -1 until then
+	GeoPoint home = {};
+	INT_T homeLine = -1;
+	// POINT_LLA operands in double precision, quanta[0] of each
+	// POINT_LLA indexes this. Only kept for llaToNed, simplifying,
+	// geofence checks and compile()
+	std::vector<GeoPoint> geoPoints;
+};
 
 #ifdef AUTOPILOT_INTERFACE
+class IncrementalAssembler;
+
+struct RouteasmResult {
+	bool success;
+	// true if the route fitted in the output given and was written
+	bool written;
+	// bytes the route assembles to, 0 if it failed
+	size_t size;
+	// errors and warnings, see Diagnostics::format(). Valid until
+	// the next routeasm_assemble() call on the same thread
+	const Diagnostics* diagnostics;
+};
+
+// thin wrappers over Assembler, the log is kept per thread
 bool routeasm(std::string inputfile, std::string filestring, uint8_t*& writeback, int& size);
 void routeasm_get_log(std::string& routeLog);
+
+// As routeasm() but keeping the route in session so later edits
+// are quick. routeasm_edit() replaces linecount lines from firstline,
+// counting from 1, with the lines of text. writeback must be the
+// buffer the last call on the session filled, it is only grown or
+// shrunk when the size changes and only changed bytes are copied
+bool routeasm_load(IncrementalAssembler& session, std::string inputfile, std::string_view filestring, uint8_t*& writeback, int& size);
+bool routeasm_edit(IncrementalAssembler& session, int firstline, int linecount, std::string_view text, uint8_t*& writeback, int& size);
+
+// Assemble source straight into output with no copies or
+// allocations beyond the assembler's own, which are kept per
+// thread between calls. If output is too small nothing is written
+// and size says how much is needed, so an empty output queries the
+// size. That query assembles the route, so hosts with a buffer that
+// is usually large enough should pass it and only retry on a miss.
+// stats, if given, has this call's counts added in ROUTEASM_STATS
+// builds, heap allocations only if the host's operator new calls
+// statAllocation()
+RouteasmResult routeasm_assemble(std::string_view inputpath, std::string_view source, std::span<uint8_t> output,
+	const AssemblerOptions& options = {}, AssemblerStats* stats = nullptr);
 #endif
 
 #endif
\ No newline at end of file
@@ -0,0 +1,176 @@
+// waypoint simplification, run before compact encoding
+//
+// Runs of consecutive POINT, or of consecutive POINT_LLA, are
+// simplified with Ramer-Douglas-Peucker: the waypoint farthest from
+// the line between a range's ends is kept and both halves are done
+// again, until every waypoint left out is within the tolerance of
+// the line it is replaced by. Any other instruction ends a run, so
+// nothing happens at a different place along the route.
+
+#include "routeasm.h"
+#include "threadpool.h"
+
+
+// ranges at least this long are handed to the pool, if there is one
+static constexpr size_t PARALLEL_POINTS = 8192;
+
+
+namespace {
+
+// waypoints of every run, one array per coordinate in metres
+struct Simplifier {
+	const double* x;
+	const double* y;
+	const double* z;
+	// not vector<bool>, tasks set their own elements
+	uint8_t* keep;
+	double tolerance2;
+	ThreadPool* pool;
+
+	void simplify(size_t first, size_t last);
+};
+
+}
+
+
+// squared distance of point i from the segment a to b
+static inline double distance2(const Simplifier& points, size_t i, size_t a, size_t b) {
+	double dx = points.x[b] - points.x[a], dy = points.y[b] - points.y[a], dz = points.z[b] - points.z[a];
+	double px = points.x[i] - points.x[a], py = points.y[i] - points.y[a], pz = points.z[i] - points.z[a];
+	double length2 = dx * dx + dy * dy + dz * dz;
+	// nearest point of the segment, as a fraction of its length
+	double t = length2 > 0 ? (px * dx + py * dy + pz * dz) / length2 : 0;
+	t = MIN_2(MAX_2(t, 0.0), 1.0);
+	px -= t * dx;
+	py -= t * dy;
+	pz -= t * dz;
+	return px * px + py * py + pz * pz;
+}
+
+
+// keep the waypoints needed between first and last, which are kept
+void Simplifier::simplify(size_t first, size_t last) {
+	std::vector<std::pair<size_t, size_t>> ranges = { { first, last } };
+	while (!ranges.empty()) {
+		auto [a, b] = ranges.back();
+		ranges.pop_back();
+
+		size_t farthest = a;
+		double worst = tolerance2;
+		for (size_t i = a + 1; i < b; ++i) {
+			double d2 = distance2(*this, i, a, b);
+			if (d2 > worst) {
+				worst = d2;
+				farthest = i;
+			}
+		}
+		if (farthest == a) continue;
+
+		keep[farthest] = 1;
+		for (auto range : { std::make_pair(a, farthest), std::make_pair(farthest, b) }) {
+			if (range.second - range.first < 2) continue;
+			if (pool && range.second - range.first >= PARALLEL_POINTS) pool->submit([this, range] { simplify(range.first, range.second); });
+			else ranges.push_back(range);
+		}
+	}
+}
+
+
+// Remove waypoints within options.simplifyTolerance metres of the
+// route through the waypoints kept. POINT_LLA runs are measured in
+// a north east down frame at their first waypoint. Long runs, and
+// long ranges within them, are simplified on pool when it is set.
+void Assembler::simplifyPoints() {
+	STAT_TIME(stats, STAT_OPTIMIZE);
+	// runs of three or more, as instruction index and length
+	std::vector<std::pair<size_t, size_t>> runs;
+	size_t total = 0;
+	for (size_t i = 0; i < instructions.size();) {
+		uint8_t opcode = instructions[i].opcode;
+		size_t end = i + 1;
+		if (opcode == POINT || opcode == POINT_LLA) {
+			while (end < instructions.size() && instructions[end].opcode == opcode) ++end;
+			if (end - i >= 3) {
+				runs.push_back({ i, end - i });
+				total += end - i;
+			}
+		}
+		i = end;
+	}
+	if (runs.empty()) return;
+
+	std::vector<double> buffer(total * 3);
+	double* x = buffer.data();
+	double* y = x + total;
+	double* z = y + total;
+	std::vector<uint8_t> keep(total, 0);
+	std::vector<double> latitude, longitude, altitude;
+	size_t at = 0;
+	for (auto [first, count] : runs) {
+		if (instructions[first].opcode == POINT) {
+			for (size_t i = 0; i < count; ++i) {
+				const RouteOp& op = instructions[first + i];
+				x[at + i] = op.coords[0];
+				y[at + i] = op.coords[1];
+				z[at + i] = op.coords[2];
+			}
+		}
+		else {
+			latitude.resize(count);
+			longitude.resize(count);
+			altitude.resize(count);
+			for (size_t i = 0; i < count; ++i) {
+				const GeoPoint& point = geoPoints[instructions[first + i].quanta[0]];
+				latitude[i] = point.latitude;
+				longitude[i] = point.longitude;
+				altitude[i] = point.altitude;
+			}
+			GeoPoint origin = geoPoints[instructions[first].quanta[0]];
+			origin.altitude = 0;
+			llaToNed(nedFrame(origin), latitude.data(), longitude.data(), altitude.data(), count, x + at, y + at, z + at);
+		}
+		keep[at] = 1;
+		keep[at + count - 1] = 1;
+		at += count;
+	}
+
+	double tolerance = options.simplifyTolerance;
+	Simplifier simplifier = { x, y, z, keep.data(), tolerance * tolerance, pool };
+	at = 0;
+	for (auto [first, count] : runs) {
+		if (pool && count >= PARALLEL_POINTS) pool->submit([&simplifier, at, count] { simplifier.simplify(at, at + count - 1); });
+		else simplifier.simplify(at, at + count - 1);
+		at += count;
+	}
+	if (pool) pool->wait();
+
+	// how far the route moved, from each waypoint left out to the
+	// segment between the kept waypoints either side of it
+	double worst = 0;
+	size_t kept = 0;
+	size_t last = 0;
+	for (size_t i = 0; i < total; ++i) {
+		if (!keep[i]) continue;
+		for (size_t j = last + 1; j < i; ++j) worst = MAX_2(worst, distance2(simplifier, j, last, i));
+		last = i;
+		++kept;
+	}
+	removedPoints = total - kept;
+	maxDeviation = std::sqrt(worst);
+	if (removedPoints == 0) return;
+
+	// drop the waypoints left out, keeping everything else in order
+	size_t out = 0;
+	size_t run = 0;
+	at = 0;
+	for (size_t i = 0; i < instructions.size(); ++i) {
+		if (run < runs.size() && i == runs[run].first + runs[run].second) {
+			at += runs[run].second;
+			++run;
+		}
+		bool inRun = run < runs.size() && i >= runs[run].first;
+		if (inRun && !keep[at + i - runs[run].first]) continue;
+		instructions[out++] = instructions[i];
+	}
+	instructions.resize(out);
+}
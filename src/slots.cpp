@@ -0,0 +1,176 @@
+// variable slot reuse, run last before serializing
+//
+// A variable is live from a write to every read that write can
+// reach. Liveness is worked out backwards over the flow between
+// instructions the block structure gives, so a variable read near
+// the top of a loop body is live all the way round the loop. Two
+// variables can share a slot unless one is written while the other
+// is live. Variables are given slots in order of first use, each
+// the lowest slot none of the variables it conflicts with holds.
+
+#include "routeasm.h"
+#include "mnemonic.h"
+
+
+// marks an instruction the route never goes on to
+static constexpr INT_T NO_TARGET = -1;
+
+
+// true if the instruction reads its variable operand k
+static bool readsVar(const RouteOp& op, INT_T k) {
+	switch (op.opcode) {
+	case INTEGER:
+		return false;
+	case ASSIGN:
+		return k == 1;
+	case ADD:
+	case SUB:
+	case MUL:
+	case DIV:
+		return k < 2;
+	default:
+		return true;
+	}
+}
+
+
+// VAR and DECL operands of an instruction
+static INT_T varCount(const RouteOp& op) {
+	const Mnemonic* mnemonic = findOpcode(op.opcode);
+	INT_T vars = 0;
+	for (INT_T i = 0; i < mnemonic->count; ++i) vars += mnemonic->operands[i] == OPERAND_VAR || mnemonic->operands[i] == OPERAND_DECL;
+	return vars;
+}
+
+
+// Number the slots of instructions again so variables whose values
+// are never needed at the same time share one, see above. A variable
+// the route reads before writing holds zero until then, as every
+// slot does at the start, so it is live from the start.
+void Assembler::allocateSlots() {
+	STAT_TIME(stats, STAT_ANALYSIS);
+	INT_T size = instructions.size();
+
+	// slots in order of first use, numbered from 0
+	INT_T order[SymbolTable::MAX_SYMBOLS];
+	for (auto& index : order) index = -1;
+	INT_T count = 0;
+	for (auto& op : instructions) {
+		for (INT_T k = 0; k < varCount(op); ++k) {
+			if (order[op.vars[k]] < 0) order[op.vars[k]] = count++;
+		}
+	}
+	variableCount = count;
+	slotCount = count;
+	if (count < 2) {
+		for (auto& op : instructions) {
+			for (INT_T k = 0; k < varCount(op); ++k) op.vars[k] = 0;
+		}
+		return;
+	}
+
+	// where each instruction can go on to besides the next one, and
+	// whether it can go to the next one
+	std::vector<INT_T> jump(size, NO_TARGET);
+	std::vector<uint8_t> falls(size, 1);
+	std::vector<INT_T> open;
+	// BREAK_WHILE waiting for the end of their loop, by loop start
+	std::vector<std::pair<INT_T, INT_T>> breaks;
+	for (INT_T i = 0; i < size; ++i) {
+		uint8_t opcode = instructions[i].opcode;
+		if (isBlockStart(opcode)) open.push_back(i);
+		else if (opcode == BREAK_WHILE) {
+			INT_T loop = open.size() - 1;
+			while (instructions[open[loop]].opcode != WHILE && instructions[open[loop]].opcode != WHILE_VAR) --loop;
+			breaks.push_back({ open[loop], i });
+			falls[i] = 0;
+		}
+		else if (opcode == END) falls[i] = 0;
+		else if (isBlockEnd(opcode)) {
+			INT_T start = open.back();
+			open.pop_back();
+			// skipping the block lands after its end
+			if (instructions[start].opcode != WHILE) jump[start] = i + 1;
+			if (opcode == ENDWHILE) {
+				jump[i] = start;
+				falls[i] = 0;
+				while (!breaks.empty() && breaks.back().first == start) {
+					jump[breaks.back().second] = i + 1;
+					breaks.pop_back();
+				}
+			}
+			else if (opcode == ENDFOR) jump[i] = start + 1;
+		}
+	}
+	// running off the end goes nowhere
+	falls[size - 1] = 0;
+	for (auto& target : jump) {
+		if (target >= size) target = NO_TARGET;
+	}
+
+	// live variables on entry to each instruction, as words of bits
+	INT_T words = (count + 63) / 64;
+	std::vector<uint64_t> live((size_t)size * words, 0);
+	std::vector<uint64_t> out(words);
+	auto liveOut = [&](INT_T i) {
+		std::fill(out.begin(), out.end(), 0);
+		for (INT_T to : { falls[i] ? i + 1 : NO_TARGET, jump[i] }) {
+			if (to == NO_TARGET) continue;
+			for (INT_T w = 0; w < words; ++w) out[w] |= live[(size_t)to * words + w];
+		}
+	};
+	// backwards over the route until nothing changes
+	for (bool changed = true; changed;) {
+		changed = false;
+		for (INT_T i = size - 1; i >= 0; --i) {
+			const RouteOp& op = instructions[i];
+			liveOut(i);
+			INT_T written = writtenSlot(op);
+			if (written >= 0) out[order[written] / 64] &= ~(1ull << (order[written] % 64));
+			for (INT_T k = 0; k < varCount(op); ++k) {
+				if (readsVar(op, k)) out[order[op.vars[k]] / 64] |= 1ull << (order[op.vars[k]] % 64);
+			}
+			uint64_t* in = &live[(size_t)i * words];
+			for (INT_T w = 0; w < words; ++w) {
+				changed |= in[w] != out[w];
+				in[w] = out[w];
+			}
+		}
+	}
+
+	// a write conflicts with every other variable live after it, but
+	// ASSIGN leaves its two variables equal so they need not differ
+	std::vector<uint64_t> conflicts((size_t)count * words, 0);
+	for (INT_T i = 0; i < size; ++i) {
+		const RouteOp& op = instructions[i];
+		INT_T written = writtenSlot(op);
+		if (written < 0) continue;
+		liveOut(i);
+		INT_T a = order[written];
+		out[a / 64] &= ~(1ull << (a % 64));
+		if (op.opcode == ASSIGN) out[order[op.vars[1]] / 64] &= ~(1ull << (order[op.vars[1]] % 64));
+		for (INT_T w = 0; w < words; ++w) conflicts[(size_t)a * words + w] |= out[w];
+	}
+	// conflicts go both ways
+	for (INT_T a = 0; a < count; ++a) {
+		for (INT_T b = 0; b < count; ++b) {
+			if (conflicts[(size_t)a * words + b / 64] >> (b % 64) & 1) conflicts[(size_t)b * words + a / 64] |= 1ull << (a % 64);
+		}
+	}
+
+	INT_T slot[SymbolTable::MAX_SYMBOLS];
+	slotCount = 0;
+	for (INT_T a = 0; a < count; ++a) {
+		bool taken[SymbolTable::MAX_SYMBOLS] = {};
+		for (INT_T b = 0; b < a; ++b) {
+			if (conflicts[(size_t)a * words + b / 64] >> (b % 64) & 1) taken[slot[b]] = true;
+		}
+		slot[a] = 0;
+		while (taken[slot[a]]) ++slot[a];
+		slotCount = MAX_2(slotCount, slot[a] + 1);
+	}
+
+	for (auto& op : instructions) {
+		for (INT_T k = 0; k < varCount(op); ++k) op.vars[k] = (uint8_t)slot[order[op.vars[k]]];
+	}
+}
@@ -0,0 +1,47 @@
+#include "stats.h"
+#include "mnemonic.h"
+
+#ifdef ROUTEASM_STATS
+thread_local uint64_t statAllocations = 0;
+thread_local uint64_t statAllocatedBytes = 0;
+#endif
+
+
+void AssemblerStats::add(const AssemblerStats& other) {
+	for (INT_T i = 0; i < STAT_PHASES; ++i) nanoseconds[i] += other.nanoseconds[i];
+	for (INT_T i = 0; i < 256; ++i) instructions[i] += other.instructions[i];
+	symbolLookups += other.symbolLookups;
+	symbolProbes += other.symbolProbes;
+	allocations += other.allocations;
+	allocatedBytes += other.allocatedBytes;
+}
+
+
+void AssemblerStats::format(std::string& out) const {
+	static const char* names[STAT_PHASES] = { "read", "parse", "  symbols", "optimize", "analysis", "encode", "write" };
+	char buffer[128];
+
+	out.append("phase            ms\n");
+	for (INT_T i = 0; i < STAT_PHASES; ++i) {
+		snprintf(buffer, sizeof(buffer), "%-12s %9.3f\n", names[i], nanoseconds[i] / 1e6);
+		out.append(buffer);
+	}
+
+	uint64_t total = 0;
+	for (auto count : instructions) total += count;
+	snprintf(buffer, sizeof(buffer), "instructions %9llu\n", (unsigned long long)total);
+	out.append(buffer);
+	for (INT_T opcode = 0; opcode < 256; ++opcode) {
+		if (!instructions[opcode]) continue;
+		std::string name(findOpcode((uint8_t)opcode)->name);
+		transform(name.begin(), name.end(), name.begin(), ::toupper);
+		snprintf(buffer, sizeof(buffer), "  %-16s %9llu\n", name.c_str(), (unsigned long long)instructions[opcode]);
+		out.append(buffer);
+	}
+
+	snprintf(buffer, sizeof(buffer), "symbol lookups %llu, probes %llu (%.2f per lookup)\n", (unsigned long long)symbolLookups,
+		(unsigned long long)symbolProbes, symbolLookups ? (double)symbolProbes / symbolLookups : 0.0);
+	out.append(buffer);
+	snprintf(buffer, sizeof(buffer), "heap allocations %llu, %llu bytes\n", (unsigned long long)allocations, (unsigned long long)allocatedBytes);
+	out.append(buffer);
+}
@@ -0,0 +1,96 @@
+// assembly statistics, collected only in ROUTEASM_STATS builds
+
+#ifndef STATS_H
+#define STATS_H
+
+#include "util.h"
+
+#include <chrono>
+
+enum StatPhase : uint8_t {
+	STAT_READ,
+	// lexing, parsing and checking lines, symbol lookup included
+	STAT_PARSE,
+	STAT_SYMBOLS,
+	STAT_OPTIMIZE,
+	// checks and passes over the finished route that are not optimizing
+	STAT_ANALYSIS,
+	STAT_ENCODE,
+	STAT_WRITE,
+	STAT_PHASES
+};
+
+// Counters for one or more assemblies. Without ROUTEASM_STATS
+// nothing is collected and every count stays zero
+struct AssemblerStats {
+	uint64_t nanoseconds[STAT_PHASES] = {};
+	// instructions written, by opcode without JUMP_FLAG
+	uint64_t instructions[256] = {};
+	uint64_t symbolLookups = 0;
+	uint64_t symbolProbes = 0;
+	// heap allocations, counted where the program's operator new
+	// calls statAllocation()
+	uint64_t allocations = 0;
+	uint64_t allocatedBytes = 0;
+
+	void clear() { *this = AssemblerStats(); }
+	void add(const AssemblerStats& other);
+	// append a readable report
+	void format(std::string& out) const;
+};
+
+#ifdef ROUTEASM_STATS
+#define STAT_COUNT(x) x
+
+// per thread totals, a program's operator new calls
+// statAllocation() to have allocations counted
+extern thread_local uint64_t statAllocations;
+extern thread_local uint64_t statAllocatedBytes;
+inline void statAllocation(size_t bytes) {
+	++statAllocations;
+	statAllocatedBytes += bytes;
+}
+
+// adds the time until it goes out of scope to a phase
+class StatTimer {
+public:
+	StatTimer(AssemblerStats* stats, StatPhase phase) : stats(stats), phase(phase) {
+		if (stats) start = std::chrono::steady_clock::now();
+	}
+	~StatTimer() {
+		if (stats) stats->nanoseconds[phase] += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+	}
+
+private:
+	AssemblerStats* stats;
+	StatPhase phase;
+	std::chrono::steady_clock::time_point start;
+};
+
+// adds heap allocations on this thread until it goes out of scope
+class StatAllocations {
+public:
+	StatAllocations(AssemblerStats* stats) : stats(stats), allocations(statAllocations), bytes(statAllocatedBytes) {}
+	~StatAllocations() {
+		if (!stats) return;
+		stats->allocations += statAllocations - allocations;
+		stats->allocatedBytes += statAllocatedBytes - bytes;
+	}
+
+private:
+	AssemblerStats* stats;
+	uint64_t allocations;
+	uint64_t bytes;
+};
+
+#define STAT_CONCAT2(a, b) a##b
+#define STAT_CONCAT(a, b) STAT_CONCAT2(a, b)
+#define STAT_TIME(stats, phase) StatTimer STAT_CONCAT(statTimer, __LINE__)(stats, phase)
+#define STAT_ALLOCATIONS(stats) StatAllocations STAT_CONCAT(statAllocations, __LINE__)(stats)
+#else
+#define STAT_COUNT(x)
+#define STAT_TIME(stats, phase)
+#define STAT_ALLOCATIONS(stats)
+#endif
+
+#endif
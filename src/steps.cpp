@@ -0,0 +1,330 @@
+// step count analysis of instruction lists, see steps.h
+
+#include "steps.h"
+#include "mnemonic.h"
+
+// largest count FOR_VAR can take from an int16 variable
+static constexpr int64_t MAX_TRIPS = 32767;
+
+// marks a path that does not exist
+static constexpr int64_t NO_PATH = -1;
+
+
+namespace {
+
+// the longest path of one kind through some code, and the events it
+// runs between as instruction indexes, -1 where it starts or ends at
+// the edge of the code
+struct Path {
+	int64_t steps = NO_PATH;
+	INT_T from = -1;
+	INT_T to = -1;
+};
+
+// longest paths over code entered at its start:
+//  through       to its end with no event
+//  head          to the first event, which is counted
+//  tail          from after the last event to its end
+//  inner         from after one event to the next
+//  breakThrough  as through, and breakTail as tail, but leaving by
+//                BREAK_WHILE for the end of the enclosing while loop
+struct Summary {
+	Path through;
+	Path head;
+	Path tail;
+	Path inner;
+	Path breakThrough;
+	Path breakTail;
+};
+
+}
+
+
+static int64_t addSteps(int64_t a, int64_t b) {
+	if (a < 0 || b < 0) return NO_PATH;
+	return a > STEPS_UNBOUNDED - b ? STEPS_UNBOUNDED : a + b;
+}
+
+
+// steps repeated times over, times may be STEPS_UNBOUNDED
+static int64_t multiplySteps(int64_t times, int64_t steps) {
+	if (times == 0) return 0;
+	if (steps <= 0) return steps;
+	return steps > STEPS_UNBOUNDED / times ? STEPS_UNBOUNDED : times * steps;
+}
+
+
+static Path join(const Path& a, const Path& b) {
+	return { addSteps(a.steps, b.steps), a.from, b.to };
+}
+
+
+// the first on a tie, so the earliest stretch is the one reported
+static Path longer(const Path& a, const Path& b) {
+	return b.steps > a.steps ? b : a;
+}
+
+
+static Summary nothing() {
+	Summary summary;
+	summary.through.steps = 0;
+	return summary;
+}
+
+
+static Summary instruction(const RouteOp& op, INT_T index) {
+	Summary summary;
+	switch (op.opcode) {
+	case POINT:
+	case POINT_LLA:
+	case POINT_Q24:
+	case POINT_D16:
+	case POINT_D8:
+	case LAUNCH:
+	case LAND:
+	case RTL:
+		summary.head = { 1, -1, index };
+		summary.tail = { 0, index, -1 };
+		break;
+	case END:
+		summary.head = { 1, -1, index };
+		break;
+	case BREAK_WHILE:
+		summary.breakThrough = { 1, -1, -1 };
+		break;
+	default:
+		summary.through = { 1, -1, -1 };
+		break;
+	}
+	return summary;
+}
+
+
+// a then b
+static Summary sequence(const Summary& a, const Summary& b) {
+	Summary summary;
+	summary.through = join(a.through, b.through);
+	summary.head = longer(a.head, join(a.through, b.head));
+	summary.tail = longer(join(a.tail, b.through), b.tail);
+	summary.inner = longer(longer(a.inner, join(a.tail, b.head)), b.inner);
+	summary.breakThrough = longer(a.breakThrough, join(a.through, b.breakThrough));
+	summary.breakTail = longer(longer(a.breakTail, join(a.tail, b.breakThrough)), b.breakTail);
+	return summary;
+}
+
+
+// a or b
+static Summary either(const Summary& a, const Summary& b) {
+	Summary summary;
+	summary.through = longer(a.through, b.through);
+	summary.head = longer(a.head, b.head);
+	summary.tail = longer(a.tail, b.tail);
+	summary.inner = longer(a.inner, b.inner);
+	summary.breakThrough = longer(a.breakThrough, b.breakThrough);
+	summary.breakTail = longer(a.breakTail, b.breakTail);
+	return summary;
+}
+
+
+// Body run times over, at least once and up to STEPS_UNBOUNDED.
+// Every run costs steps, so a path is longest either within one run
+// or across as many runs as there are.
+static Summary repeat(const Summary& body, int64_t times) {
+	auto around = [&](int64_t runs) { return Path{ multiplySteps(runs, body.through.steps), -1, -1 }; };
+	int64_t others = times == STEPS_UNBOUNDED ? times : times - 1;
+	Summary summary;
+	summary.through = around(times);
+	summary.head = longer(body.head, join(around(others), body.head));
+	summary.tail = longer(body.tail, join(body.tail, around(others)));
+	summary.inner = body.inner;
+	summary.breakThrough = longer(body.breakThrough, join(around(others), body.breakThrough));
+	summary.breakTail = body.breakTail;
+	if (times >= 2) {
+		// from an event in one run to one in a later run, the next
+		// run if no run can go through without an event
+		Path between = body.tail;
+		if (body.through.steps >= 0) between = join(body.tail, around(times == STEPS_UNBOUNDED ? times : times - 2));
+		summary.inner = longer(summary.inner, join(between, body.head));
+		summary.breakTail = longer(summary.breakTail, join(between, body.breakThrough));
+	}
+	return summary;
+}
+
+
+// A loop with no bound whose body can run through without an event
+// may never reach the next one, which is reported at the loop.
+static void spin(Summary& loop, const Summary& body, INT_T index) {
+	if (body.through.steps < 0) return;
+	loop.head = longer({ STEPS_UNBOUNDED, -1, index }, loop.head);
+	if (body.tail.steps >= 0) loop.inner = longer({ STEPS_UNBOUNDED, body.tail.from, index }, loop.inner);
+}
+
+
+bool analyzeSteps(const std::vector<RouteOp>& code, StepReport& report, INT_T& at) {
+	report.worst = 0;
+	report.from = -1;
+	report.to = -1;
+	report.loops.clear();
+
+	// constant FOR_VAR counts, as the optimizer finds them
+	INT_T writes[256] = {};
+	INT_T definition[256];
+	for (auto& index : definition) index = -1;
+	INT_T depth = 0;
+	for (INT_T i = 0; i < _INT(code.size()); ++i) {
+		const RouteOp& op = code[i];
+		if (isBlockStart(op.opcode)) ++depth;
+		else if (isBlockEnd(op.opcode)) --depth;
+		INT_T slot = writtenSlot(op);
+		if (slot < 0) continue;
+		++writes[slot];
+		if (op.opcode == INTEGER && depth == 0) definition[slot] = i;
+	}
+
+	// open blocks, the first is the whole program
+	struct Frame {
+		INT_T start;
+		Summary body;
+		// index in report.loops, -1 for IF_x
+		INT_T loop;
+	};
+	std::vector<Frame> frames = { { -1, nothing(), -1 } };
+	INT_T whiles = 0;
+	for (INT_T i = 0; i < _INT(code.size()); ++i) {
+		const RouteOp& op = code[i];
+		if (isBlockStart(op.opcode)) {
+			INT_T loop = -1;
+			if (op.opcode == WHILE || op.opcode == WHILE_VAR || op.opcode == FOR || op.opcode == FOR_VAR) {
+				loop = _INT(report.loops.size());
+				report.loops.push_back({ i, op.opcode, STEPS_UNBOUNDED, false });
+			}
+			whiles += op.opcode == WHILE || op.opcode == WHILE_VAR;
+			frames.push_back({ i, nothing(), loop });
+			continue;
+		}
+		if (op.opcode == BREAK_WHILE && whiles == 0) {
+			at = i;
+			return false;
+		}
+		if (!isBlockEnd(op.opcode)) {
+			frames.back().body = sequence(frames.back().body, instruction(op, i));
+			continue;
+		}
+
+		if (frames.size() < 2) {
+			at = i;
+			return false;
+		}
+		Frame frame = frames.back();
+		frames.pop_back();
+		const RouteOp& start = code[frame.start];
+		bool whileLoop = start.opcode == WHILE || start.opcode == WHILE_VAR;
+		bool forLoop = start.opcode == FOR || start.opcode == FOR_VAR;
+		if (op.opcode == ENDWHILE ? !whileLoop : op.opcode == ENDFOR ? !forLoop : whileLoop || forLoop) {
+			at = i;
+			return false;
+		}
+
+		Summary block;
+		if (forLoop) {
+			LoopBound& bound = report.loops[frame.loop];
+			INT_T slot = start.vars[0];
+			if (start.opcode == FOR) bound.exact = true;
+			else bound.exact = writes[slot] == 1 && definition[slot] >= 0 && definition[slot] < frame.start;
+			int64_t count = start.opcode == FOR ? start.immediate : bound.exact ? code[definition[slot]].immediate : MAX_TRIPS;
+			bound.trips = MAX_2(count, (int64_t)0);
+			Summary runs = bound.trips > 0 ? repeat(sequence(frame.body, instruction(op, i)), bound.trips) : nothing();
+			block = sequence(instruction(start, frame.start), bound.exact ? runs : either(nothing(), runs));
+		}
+		else if (whileLoop) {
+			--whiles;
+			Summary body = sequence(sequence(instruction(start, frame.start), frame.body), instruction(op, i));
+			Summary runs = repeat(body, STEPS_UNBOUNDED);
+			spin(runs, body, frame.start);
+			if (start.opcode == WHILE) {
+				// only BREAK_WHILE leaves
+				block = runs;
+				block.through = runs.breakThrough;
+				block.tail = runs.breakTail;
+			}
+			else {
+				block = sequence(either(nothing(), runs), instruction(start, frame.start));
+				block.through = longer(block.through, block.breakThrough);
+				block.tail = longer(block.tail, block.breakTail);
+			}
+			block.breakThrough = Path();
+			block.breakTail = Path();
+		}
+		else block = sequence(instruction(start, frame.start), either(sequence(frame.body, instruction(op, i)), nothing()));
+		frames.back().body = sequence(frames.back().body, block);
+	}
+	if (frames.size() > 1) {
+		at = frames.back().start;
+		return false;
+	}
+
+	Path worst = longer(frames[0].body.head, frames[0].body.inner);
+	report.worst = MAX_2(worst.steps, (int64_t)0);
+	report.from = worst.from;
+	report.to = worst.to;
+	return true;
+}
+
+
+void StepReport::format(std::string& out) const {
+	char buffer[128];
+	auto position = [&](INT_T index) {
+		std::string text = "the start";
+		if (index >= 0) text = "offset " + std::to_string(offsets[index]);
+		return text;
+	};
+
+	bool endless = false;
+	for (auto& loop : loops) endless |= worst == STEPS_UNBOUNDED && loop.index == to;
+	if (endless) {
+		out.append("longest stretch: the loop at ").append(position(to)).append(" can run without end after ").append(position(from)).append("\n");
+	}
+	else if (to >= 0) {
+		snprintf(buffer, sizeof(buffer), "longest stretch: %lld instructions, ", (long long)worst);
+		out.append(buffer).append(position(from)).append(" to ").append(position(to)).append("\n");
+	}
+	else out.append("longest stretch: none, the route never reaches an event or END\n");
+
+	if (loops.empty()) return;
+	out.append("\nloop at         opcode      runs\n");
+	for (auto& loop : loops) {
+		std::string name(findOpcode(loop.opcode)->name);
+		transform(name.begin(), name.end(), name.begin(), ::toupper);
+		const char* kind = loop.exact ? "" : loop.trips == STEPS_UNBOUNDED ? "unbounded" : "at most ";
+		snprintf(buffer, sizeof(buffer), "%10u      %-11s %s", (unsigned)offsets[loop.index], name.c_str(), kind);
+		out.append(buffer);
+		if (loop.trips != STEPS_UNBOUNDED) out.append(std::to_string(loop.trips));
+		out.push_back('\n');
+	}
+}
+
+
+// Fail if the longest stretch of instructions is over
+// options.stepBudget, reporting it at the instruction it ends on
+bool Assembler::checkSteps() {
+	STAT_TIME(stats, STAT_ANALYSIS);
+	StepReport report;
+	INT_T at;
+	// blocks were checked while parsing, so this only fails if a pass broke them
+	if (!analyzeSteps(instructions, report, at)) {
+		diagnostics.file = instructions[at].file;
+		diagnostics.report(DIAG_STEPS_UNCOUNTED, instructions[at].line);
+		return false;
+	}
+	worstSteps = report.worst;
+	if (report.worst <= options.stepBudget) return true;
+
+	bool endless = report.worst == STEPS_UNBOUNDED && report.to >= 0 && isBlockStart(instructions[report.to].opcode);
+	INT_T line = report.to < 0 ? -1 : instructions[report.to].line;
+	diagnostics.file = report.to < 0 ? 0 : instructions[report.to].file;
+	INT_T from = -1;
+	if (report.from >= 0) from = instructions[report.from].file == diagnostics.file ? instructions[report.from].line : -2;
+	diagnostics.report(DIAG_STEP_BUDGET, line, -1, {},
+		endless ? -1 : (int32_t)MIN_2(report.worst, (int64_t)INT32_MAX), (int32_t)from, (int32_t)options.stepBudget);
+	return false;
+}
@@ -0,0 +1,51 @@
+// worst case interpreter work between waypoints
+
+#ifndef STEPS_H
+#define STEPS_H
+
+#include "routeasm.h"
+
+// step counts too large to hold, or loops that may never finish
+#define STEPS_UNBOUNDED INT64_MAX
+
+// how many times a loop body can run
+struct LoopBound {
+	// instruction index of the FOR, FOR_VAR, WHILE or WHILE_VAR
+	INT_T index;
+	uint8_t opcode;
+	// STEPS_UNBOUNDED for while loops. FOR_VAR on a variable that is
+	// not constant, see below, is bounded by the largest int16
+	int64_t trips;
+	// FOR, or FOR_VAR on a variable whose only write is one INTEGER
+	// outside every block and before the loop
+	bool exact;
+};
+
+// A stretch is what the interpreter runs from a waypoint or
+// flight mode change, or the start, up to and including the next
+// one or END. That is the work between two route events, so
+// the longest stretch bounds the time one event can take.
+struct StepReport {
+	// instructions in the longest stretch
+	int64_t worst = 0;
+	// instruction indexes of its ends, from is -1 for the start. When
+	// a while loop can run without end before the next event, worst
+	// is STEPS_UNBOUNDED and to is the loop
+	INT_T from = -1;
+	INT_T to = -1;
+	std::vector<LoopBound> loops;
+	// byte offset of each instruction, only set by stepReport()
+	std::vector<uint32_t> offsets;
+
+	// append the worst stretch by byte offset, and every loop
+	void format(std::string& out) const;
+};
+
+// Find the longest stretch of code by composing, block by block,
+// the longest paths into, out of, through and within each block.
+// Conditions are taken either way. False, with at set to the
+// instruction, if blocks do not nest or BREAK_WHILE is outside a
+// while loop, which only code not from Assembler can have.
+bool analyzeSteps(const std::vector<RouteOp>& code, StepReport& report, INT_T& at);
+
+#endif
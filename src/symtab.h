@@ -0,0 +1,106 @@
+// variable symbol table
+
+#ifndef SYMTAB_H
+#define SYMTAB_H
+
+#include "util.h"
+#include "stats.h"
+
+// Flat open addressing table from variable name to slot index.
+// Names are interned as views into the source buffer, so the
+// table must be cleared before that buffer is released. All
+// storage is inline: declaring and looking up never allocate.
+// Names compare ignoring ASCII case.
+class SymbolTable {
+public:
+	// slots are encoded in one byte
+	static constexpr INT_T MAX_SYMBOLS = 256;
+
+	SymbolTable() { clear(); }
+
+	void clear() {
+		for (INT_T i = 0; i < count; ++i) entries[positions[i]].slot = -1;
+		if (count == 0) {
+			for (auto& entry : entries) entry.slot = -1;
+		}
+		count = 0;
+	}
+
+	// slot of name, -1 if not declared
+	INT_T find(std::string_view name) const {
+		STAT_COUNT(++lookups);
+		uint32_t hash = hashName(name);
+		for (uint32_t i = hash & (CAPACITY - 1);; i = (i + 1) & (CAPACITY - 1)) {
+			STAT_COUNT(++probes);
+			const Entry& entry = entries[i];
+			if (entry.slot < 0) return -1;
+			if (entry.hash == hash && equalsIgnoreCase(entry.name, name)) return entry.slot;
+		}
+	}
+
+	// slot for name, adding it if new, a name declared
+	// again keeps its slot. Returns -1 if the table is full
+	INT_T declare(std::string_view name) {
+		STAT_COUNT(++lookups);
+		uint32_t hash = hashName(name);
+		uint32_t i = hash & (CAPACITY - 1);
+		for (;; i = (i + 1) & (CAPACITY - 1)) {
+			STAT_COUNT(++probes);
+			const Entry& entry = entries[i];
+			if (entry.slot < 0) break;
+			if (entry.hash == hash && equalsIgnoreCase(entry.name, name)) return entry.slot;
+		}
+		if (count >= MAX_SYMBOLS) return -1;
+
+		entries[i] = { name, hash, (int16_t)count };
+		positions[count] = (uint16_t)i;
+		return count++;
+	}
+
+	INT_T size() const { return count; }
+
+	// name a slot was declared with
+	std::string_view name(INT_T slot) const { return entries[positions[slot]].name; }
+
+#ifdef ROUTEASM_STATS
+	// finds and declares, and entries looked at by them
+	mutable uint64_t lookups = 0;
+	mutable uint64_t probes = 0;
+#endif
+
+private:
+	// power of two at most half full
+	static constexpr uint32_t CAPACITY = MAX_SYMBOLS * 2;
+
+	struct Entry {
+		std::string_view name;
+		uint32_t hash;
+		// -1 for an empty entry
+		int16_t slot;
+	};
+
+	// case insensitive FNV-1a
+	static uint32_t hashName(std::string_view name) {
+		uint32_t hash = 2166136261u;
+		for (char c : name) {
+			hash ^= (uint8_t)asciiLower(c);
+			hash *= 16777619u;
+		}
+		return hash ^ (hash >> 15);
+	}
+
+	static bool equalsIgnoreCase(std::string_view a, std::string_view b) {
+		if (a.size() != b.size()) return false;
+		for (size_t i = 0; i < a.size(); ++i) {
+			if (asciiLower(a[i]) != asciiLower(b[i])) return false;
+		}
+		return true;
+	}
+
+	Entry entries[CAPACITY];
+	// entry index of each slot
+	uint16_t positions[MAX_SYMBOLS];
+	INT_T count = 0;
+};
+
+#endif
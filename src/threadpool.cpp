@@ -0,0 +1,90 @@
+#include "threadpool.h"
+
+
+ThreadPool::ThreadPool(INT_T threads) {
+	if (threads < 1) threads = MAX_2(_INT(std::thread::hardware_concurrency()), 1);
+
+	for (INT_T i = 0; i < threads; ++i) workers.push_back(std::make_unique<Worker>());
+	// start threads once every queue exists so steal() never sees a partial list
+	for (UINT_T i = 0; i < workers.size(); ++i) {
+		workers[i]->thread = std::thread(&ThreadPool::run, this, i);
+	}
+}
+
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard<std::mutex> guard(sleepLock);
+		stopping = true;
+	}
+	wake.notify_all();
+	for (auto& worker : workers) worker->thread.join();
+}
+
+
+void ThreadPool::submit(std::function<void()> task) {
+	++pending;
+	Worker& worker = *workers[next.fetch_add(1, std::memory_order_relaxed) % workers.size()];
+	{
+		std::lock_guard<std::mutex> guard(worker.lock);
+		worker.tasks.push_back(std::move(task));
+	}
+	{
+		std::lock_guard<std::mutex> guard(sleepLock);
+		++queued;
+	}
+	wake.notify_one();
+}
+
+
+void ThreadPool::wait() {
+	std::unique_lock<std::mutex> guard(sleepLock);
+	done.wait(guard, [this] { return pending == 0; });
+}
+
+
+bool ThreadPool::pop(UINT_T index, std::function<void()>& task) {
+	Worker& worker = *workers[index];
+	std::lock_guard<std::mutex> guard(worker.lock);
+	if (worker.tasks.empty()) return false;
+	task = std::move(worker.tasks.back());
+	worker.tasks.pop_back();
+	return true;
+}
+
+
+bool ThreadPool::steal(UINT_T index, std::function<void()>& task) {
+	for (UINT_T i = 1; i < workers.size(); ++i) {
+		Worker& victim = *workers[(index + i) % workers.size()];
+		std::lock_guard<std::mutex> guard(victim.lock);
+		if (victim.tasks.empty()) continue;
+		task = std::move(victim.tasks.front());
+		victim.tasks.pop_front();
+		return true;
+	}
+	return false;
+}
+
+
+void ThreadPool::run(UINT_T index) {
+	while (true) {
+		std::function<void()> task;
+		if (pop(index, task) || steal(index, task)) {
+			{
+				std::lock_guard<std::mutex> guard(sleepLock);
+				--queued;
+			}
+			task();
+			if (--pending == 0) {
+				// take the lock so wait() cannot miss the notification
+				std::lock_guard<std::mutex> guard(sleepLock);
+				done.notify_all();
+			}
+			continue;
+		}
+
+		std::unique_lock<std::mutex> guard(sleepLock);
+		wake.wait(guard, [this] { return stopping || queued > 0; });
+		if (stopping && queued == 0) return;
+	}
+}
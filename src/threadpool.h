@@ -0,0 +1,62 @@
+// work stealing thread pool
+
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include "util.h"
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <deque>
+#include <atomic>
+#include <memory>
+
+// Each worker owns a task queue and takes work from
+// the back of it, idle workers steal from the front
+// of other workers' queues so uneven task lengths
+// still keep every thread busy.
+class ThreadPool {
+public:
+	// threads < 1 uses the hardware thread count
+	ThreadPool(INT_T threads = 0);
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	// queue task, tasks are spread across workers round robin
+	void submit(std::function<void()> task);
+	// block until every submitted task has finished
+	void wait();
+
+	INT_T size() const { return workers.size(); }
+
+private:
+	struct Worker {
+		std::deque<std::function<void()>> tasks;
+		std::mutex lock;
+		std::thread thread;
+	};
+
+	void run(UINT_T index);
+	bool pop(UINT_T index, std::function<void()>& task);
+	bool steal(UINT_T index, std::function<void()>& task);
+
+	std::vector<std::unique_ptr<Worker>> workers;
+	// workers may submit too, so the round robin position is atomic
+	std::atomic<UINT_T> next{0};
+
+	// tasks sitting in queues, guarded by sleepLock
+	UINT_T queued = 0;
+	// tasks submitted but not yet finished
+	std::atomic<UINT_T> pending{0};
+	bool stopping = false;
+
+	std::mutex sleepLock;
+	std::condition_variable wake;
+	std::condition_variable done;
+};
+
+#endif
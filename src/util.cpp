@@ -0,0 +1,91 @@
+#include "util.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+
+#ifdef _WIN32
+bool MappedFile::open(const std::string& filePath) {
+	close();
+	HANDLE f = CreateFileA(filePath.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (f == INVALID_HANDLE_VALUE) return false;
+	file = f;
+
+	LARGE_INTEGER filesize;
+	if (!GetFileSizeEx(f, &filesize)) {
+		close();
+		return false;
+	}
+	length = (size_t)filesize.QuadPart;
+	// empty files cannot be mapped, leave an empty view
+	if (length == 0) return true;
+
+	map = CreateFileMappingA(f, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (!map) {
+		close();
+		return false;
+	}
+	mapping = (const char*)MapViewOfFile(map, FILE_MAP_READ, 0, 0, 0);
+	if (!mapping) {
+		close();
+		return false;
+	}
+	return true;
+}
+
+
+void MappedFile::close() {
+	if (mapping) UnmapViewOfFile(mapping);
+	if (map) CloseHandle(map);
+	if (file) CloseHandle(file);
+	mapping = nullptr;
+	map = nullptr;
+	file = nullptr;
+	length = 0;
+}
+#else
+bool MappedFile::open(const std::string& filePath) {
+	close();
+	int f = ::open(filePath.c_str(), O_RDONLY);
+	if (f < 0) return false;
+
+	struct stat filestat;
+	if (fstat(f, &filestat) != 0 || !S_ISREG(filestat.st_mode)) {
+		::close(f);
+		return false;
+	}
+	length = (size_t)filestat.st_size;
+	// empty files cannot be mapped, leave an empty view
+	if (length == 0) {
+		::close(f);
+		return true;
+	}
+
+	void* map = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, f, 0);
+	// the mapping holds its own reference to the file
+	::close(f);
+	if (map == MAP_FAILED) {
+		length = 0;
+		return false;
+	}
+	// source is read once front to back
+	madvise(map, length, MADV_SEQUENTIAL);
+	mapping = (const char*)map;
+	return true;
+}
+
+
+void MappedFile::close() {
+	if (mapping) munmap((void*)mapping, length);
+	mapping = nullptr;
+	length = 0;
+}
+#endif
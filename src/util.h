@@ -7,6 +7,7 @@
 
 #include <iostream>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <fstream>
 #include <cstdlib>
@@ -18,6 +19,7 @@
 #include <filesystem>
 #include <algorithm>
 #include <map>
+#include <charconv>
 
 #if defined(_MSC_VER) && !defined(_CRT_SECURE_NO_WARNINGS)
 #define _CRT_SECURE_NO_WARNINGS
@@ -29,15 +31,13 @@
 
 // type definitions
 
-#if _WIN64
+#if defined(_WIN64) || UINTPTR_MAX == UINT64_MAX
 #define _ENV64
-#else
-#if _WIN32
+#elif defined(_WIN32) || UINTPTR_MAX == UINT32_MAX
 #define _ENV32
 #else
 #error UNKNOWN_WORD_SIZE
 #endif
-#endif
 
 // some type macros
 #ifdef _ENV64
@@ -89,6 +89,83 @@ typedef union {
 	uint8_t reg[4];
 } Float_Converter;
 
+enum ParseError {
+	PARSE_OK,
+	PARSE_INVALID,
+	PARSE_RANGE
+};
+
+// Parse a whole token as a float or double, locale independent and
+// correctly rounded. errorpos is set to the offset of the first bad character.
+template <typename T>
+inline ParseError parseFloat(std::string_view token, T& value, size_t& errorpos) {
+	const char* first = token.data();
+	const char* last = first + token.size();
+	// from_chars takes no leading '+', and a sign after it is not valid
+	if (first < last && *first == '+') {
+		++first;
+		if (first < last && *first == '-') {
+			errorpos = 1;
+			return PARSE_INVALID;
+		}
+	}
+	auto result = std::from_chars(first, last, value);
+	errorpos = result.ptr - token.data();
+	if (result.ec == std::errc::result_out_of_range) {
+		errorpos = 0;
+		return PARSE_RANGE;
+	}
+	if (result.ec != std::errc() || result.ptr != last) return PARSE_INVALID;
+	// from_chars accepts inf and nan
+	if (!std::isfinite(value)) {
+		errorpos = 0;
+		return PARSE_INVALID;
+	}
+	return PARSE_OK;
+}
+
+// Parse a whole token as an integer in [min, max].
+// errorpos is set to the offset of the first bad character.
+inline ParseError parseInt(std::string_view token, int32_t& value, int32_t min, int32_t max, size_t& errorpos) {
+	const char* first = token.data();
+	const char* last = first + token.size();
+	if (first < last && *first == '+') {
+		++first;
+		if (first < last && *first == '-') {
+			errorpos = 1;
+			return PARSE_INVALID;
+		}
+	}
+	int32_t wide;
+	auto result = std::from_chars(first, last, wide);
+	errorpos = result.ptr - token.data();
+	if (result.ec == std::errc() && result.ptr == last && (wide < min || wide > max)) {
+		errorpos = 0;
+		return PARSE_RANGE;
+	}
+	if (result.ec == std::errc::result_out_of_range) {
+		errorpos = 0;
+		return PARSE_RANGE;
+	}
+	if (result.ec != std::errc() || result.ptr != last) return PARSE_INVALID;
+	value = wide;
+	return PARSE_OK;
+}
+
+// Parse a whole token as a 16 bit signed integer.
+inline ParseError parseInt16(std::string_view token, int16_t& value, size_t& errorpos) {
+	int32_t wide;
+	ParseError error = parseInt(token, wide, INT16_MIN, INT16_MAX, errorpos);
+	if (error == PARSE_OK) value = (int16_t)wide;
+	return error;
+}
+
+
+constexpr char asciiLower(char c) {
+	return (c >= 'A' && c <= 'Z') ? c - 'A' + 'a' : c;
+}
+
+
 // Reads file given in const char* path
 // to C++ std::string. Uses container type
 // because returning dynamically allocated arrays
@@ -101,10 +178,8 @@ bool readFileToString(T filePath, std::string& writeback) {
 	std::ifstream f(filePath);
 	// check if file successfully opened
 	// therefore check if the file exists
-	if (!f.is_open()) {
-		std::cout << "Error: could not find file: " << filePath << "\n";
-		return false;
-	}
+	// caller reports the error
+	if (!f.is_open()) return false;
 	// use stringstream as a go between
 	std::stringstream buffer;
 	buffer << f.rdbuf();
@@ -117,6 +192,35 @@ bool readFileToString(T filePath, std::string& writeback) {
 }
 
 
+// Read only memory map of a whole file.
+// The mapping is released when the object is destroyed,
+// views into data() must not outlive it.
+class MappedFile {
+public:
+	MappedFile() = default;
+	~MappedFile() { close(); }
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	// map file, returns false if it cannot be opened
+	bool open(const std::string& filePath);
+	void close();
+
+	const char* data() const { return mapping; }
+	size_t size() const { return length; }
+	std::string_view view() const { return std::string_view(mapping, length); }
+
+private:
+	const char* mapping = nullptr;
+	size_t length = 0;
+#ifdef _WIN32
+	void* file = nullptr;
+	void* map = nullptr;
+#endif
+};
+
+
 template <typename T>
 void writeStringToFile(T filePath, std::string& string) {
 	// create file
@@ -0,0 +1,411 @@
+#include "vm.h"
+#include "mnemonic.h"
+
+#if defined(__GNUC__)
+#define VM_DIRECT_THREADED
+#endif
+
+// opcodes with a handler in run(), X(opcode, label)
+#define VM_OPCODES(X) \
+	X(POINT, point) \
+	X(POINT_LLA, point_lla) \
+	X(POINT_RESOLUTION, point_resolution) \
+	X(POINT_Q24, point_q24) \
+	X(POINT_D16, point_delta) \
+	X(POINT_D8, point_delta) \
+	X(PRINT, print) \
+	X(WHILE, while) \
+	X(WHILE_VAR, while_var) \
+	X(ENDWHILE, endwhile) \
+	X(BREAK_WHILE, break_while) \
+	X(FOR, for) \
+	X(FOR_VAR, for_var) \
+	X(ENDFOR, endfor) \
+	X(INTEGER, integer) \
+	X(INCREMENT, increment) \
+	X(DECREMENT, decrement) \
+	X(ADD, add) \
+	X(SUB, sub) \
+	X(MUL, mul) \
+	X(DIV, div) \
+	X(ADD_ASSIGN, add_assign) \
+	X(SUB_ASSIGN, sub_assign) \
+	X(MUL_ASSIGN, mul_assign) \
+	X(DIV_ASSIGN, div_assign) \
+	X(ASSIGN, assign) \
+	X(IF_Z, if_z) \
+	X(IF_NZ, if_nz) \
+	X(IF_POS, if_pos) \
+	X(IF_NEG, if_neg) \
+	X(ENDIF, endif) \
+	X(END, end) \
+	X(LAUNCH, launch) \
+	X(LAND, land) \
+	X(RTL, rtl)
+
+
+bool RouteVm::fail(const char* message, uint32_t offset) {
+	error = message;
+	errorOffset = offset;
+	code.clear();
+	return false;
+}
+
+
+bool RouteVm::load(const uint8_t* program, size_t size) {
+	code.clear();
+	threaded = false;
+	error = nullptr;
+	errorOffset = 0;
+
+	// open blocks, instruction indices
+	std::vector<uint32_t> blocks;
+	INT_T fordepth = 0, maxfordepth = 0;
+
+	// encoded jumps to check once targets are resolved
+	struct Jump {
+		uint32_t index;
+		int64_t to;
+		uint8_t pops;
+	};
+	std::vector<Jump> jumps;
+
+	INT_T header = readSlotCount(program, size, slots);
+	if (header < 0) return fail("damaged slot count", 0);
+	size_t pc = header;
+	while (pc < size) {
+		// the leg table is for the flight controller and ends the program
+		if (program[pc] == LEG_TABLE) {
+			if (!validLegTable(program, size, pc)) return fail("damaged leg table", pc);
+			size = pc;
+			break;
+		}
+		INT_T length = instructionSize(program[pc]);
+		if (length < 0) return fail("unknown opcode", pc);
+		if (pc + length > size) return fail("truncated instruction", pc);
+		const Mnemonic* mnemonic = findOpcode(program[pc] & ~JUMP_FLAG);
+
+		Instruction insn = {};
+		insn.opcode = mnemonic->opcode;
+		insn.offset = pc;
+		const uint8_t* operand = program + pc + 1;
+		INT_T vars = 0, floats = 0;
+		for (INT_T i = 0; i < mnemonic->count; ++i) {
+			switch (mnemonic->operands[i]) {
+			case OPERAND_VAR:
+			case OPERAND_DECL:
+				if (*operand >= slots) return fail("variable outside slot count", pc);
+				insn.operands[vars++] = *operand;
+				break;
+			case OPERAND_INT:
+				insn.immediate = (int16_t)(operand[0] | (operand[1] << 8));
+				break;
+			case OPERAND_FLOAT:
+				memcpy(&insn.coords[floats++], operand, 4);
+				break;
+			case OPERAND_Q8:
+				insn.quanta[i] = (int8_t)operand[0];
+				break;
+			case OPERAND_Q16:
+				insn.quanta[i] = (int16_t)(operand[0] | (operand[1] << 8));
+				break;
+			case OPERAND_Q24:
+				// sign extend from the top byte
+				insn.quanta[i] = (int32_t)((uint32_t)operand[0] << 8 | (uint32_t)operand[1] << 16 | (uint32_t)operand[2] << 24) >> 8;
+				break;
+			}
+			operand += operandSize(mnemonic->operands[i]);
+		}
+
+		uint32_t index = code.size();
+		if (program[pc] & JUMP_FLAG) {
+			int32_t offset = (int32_t)((uint32_t)operand[0] | ((uint32_t)operand[1] << 8) |
+				((uint32_t)operand[2] << 16) | ((uint32_t)operand[3] << 24));
+			jumps.push_back({ index, (int64_t)pc + length + offset, insn.opcode == BREAK_WHILE ? operand[4] : (uint8_t)0 });
+		}
+
+		switch (insn.opcode) {
+		case FOR:
+		case FOR_VAR:
+			maxfordepth = MAX_2(maxfordepth, ++fordepth);
+			blocks.push_back(index);
+			break;
+
+		case WHILE:
+		case WHILE_VAR:
+		case IF_Z:
+		case IF_NZ:
+		case IF_POS:
+		case IF_NEG:
+			blocks.push_back(index);
+			break;
+
+		case ENDWHILE:
+		case ENDFOR:
+		case ENDIF: {
+			if (blocks.empty()) return fail("block end without start", pc);
+			Instruction& open = code[blocks.back()];
+			bool match;
+			if (insn.opcode == ENDWHILE) match = open.opcode == WHILE || open.opcode == WHILE_VAR;
+			else if (insn.opcode == ENDFOR) match = open.opcode == FOR || open.opcode == FOR_VAR;
+			else match = open.opcode >= IF_Z && open.opcode <= IF_NEG;
+			if (!match) return fail("mismatched block end", pc);
+
+			// skipping a block lands after its end
+			open.target = index + 1;
+			// ENDWHILE retests its condition, ENDFOR goes to the body
+			if (insn.opcode == ENDWHILE) insn.target = blocks.back();
+			else if (insn.opcode == ENDFOR) {
+				insn.target = blocks.back() + 1;
+				--fordepth;
+			}
+			blocks.pop_back();
+			break;
+		}
+
+		case BREAK_WHILE: {
+			INT_T i = blocks.size() - 1;
+			for (; i >= 0; --i) {
+				uint8_t opcode = code[blocks[i]].opcode;
+				if (opcode == WHILE || opcode == WHILE_VAR) break;
+				if (opcode == FOR || opcode == FOR_VAR) ++insn.pops;
+			}
+			if (i < 0) return fail("BREAK_WHILE outside while loop", pc);
+			// point at the loop for now, resolved once it is closed
+			insn.target = blocks[i];
+			break;
+		}
+		}
+
+		code.push_back(insn);
+		pc += length;
+	}
+
+	if (!blocks.empty()) return fail("unclosed block", code[blocks.back()].offset);
+
+	for (auto& insn : code) {
+		if (insn.opcode == BREAK_WHILE) insn.target = code[insn.target].target;
+	}
+
+	// sentinel catches running off the end
+	Instruction sentinel = {};
+	sentinel.offset = size;
+	code.push_back(sentinel);
+
+	// encoded offsets must agree with the block structure
+	for (auto& jump : jumps) {
+		Instruction& insn = code[jump.index];
+		auto target = std::lower_bound(code.begin(), code.end(), jump.to,
+			[](const Instruction& a, int64_t offset) { return a.offset < offset; });
+		if (target == code.end() || target->offset != jump.to || (uint32_t)(target - code.begin()) != insn.target ||
+			jump.pops != insn.pops) {
+			return fail("jump offset does not match block structure", insn.offset);
+		}
+	}
+
+	counters.reserve(maxfordepth);
+	return true;
+}
+
+
+VmResult RouteVm::run(uint64_t budget, std::vector<RouteEvent>* events) {
+	VmResult result = { VM_ERROR, 0, 0, "no program loaded" };
+	if (code.empty()) return result;
+
+	memset(variables, 0, slots * sizeof(variables[0]));
+	counters.clear();
+	int16_t* vars = variables;
+	uint64_t steps = 0;
+
+#ifdef VM_DIRECT_THREADED
+	if (!threaded) {
+		for (auto& insn : code) {
+			switch (insn.opcode) {
+#define VM_THREAD(opcode, label) case opcode: insn.handler = &&op_##label; break;
+			VM_OPCODES(VM_THREAD)
+#undef VM_THREAD
+			default: insn.handler = &&op_invalid; break;
+			}
+		}
+		threaded = true;
+	}
+#define DISPATCH() goto *ip->handler
+#else
+#define DISPATCH() goto dispatch
+#endif
+
+// move to instruction and run it if budget remains
+#define NEXT(to) do { ip = (to); if (steps == budget) goto out_of_budget; ++steps; DISPATCH(); } while (0)
+#define EVENT(opcode, value, coords) do { if (events) events->push_back({ (opcode), (int16_t)(value), \
+	{ (coords)[0], (coords)[1], (coords)[2] }, ip->offset, steps }); } while (0)
+
+	const Instruction* base = code.data();
+	const Instruction* ip = base;
+	const float none[3] = { 0, 0, 0 };
+	// compact point state
+	float resolution = 1;
+	int32_t position[3] = { 0, 0, 0 };
+	float point[3];
+	NEXT(base);
+
+#ifndef VM_DIRECT_THREADED
+dispatch:
+	switch (ip->opcode) {
+#define VM_CASE(opcode, label) case opcode: goto op_##label;
+	VM_OPCODES(VM_CASE)
+#undef VM_CASE
+	default: goto op_invalid;
+	}
+#endif
+
+op_point:
+op_point_lla:
+	EVENT(ip->opcode, 0, ip->coords);
+	NEXT(ip + 1);
+
+op_point_resolution:
+	resolution = ip->coords[0];
+	NEXT(ip + 1);
+
+op_point_q24:
+	for (INT_T i = 0; i < 3; ++i) {
+		position[i] = ip->quanta[i];
+		point[i] = (float)position[i] * resolution;
+	}
+	EVENT(POINT, 0, point);
+	NEXT(ip + 1);
+
+op_point_delta:
+	for (INT_T i = 0; i < 3; ++i) {
+		position[i] = (int32_t)((uint32_t)position[i] + (uint32_t)ip->quanta[i]);
+		point[i] = (float)position[i] * resolution;
+	}
+	EVENT(POINT, 0, point);
+	NEXT(ip + 1);
+
+op_launch:
+op_land:
+op_rtl:
+	EVENT(ip->opcode, 0, none);
+	NEXT(ip + 1);
+
+op_print:
+	EVENT(ip->opcode, vars[ip->operands[0]], none);
+	NEXT(ip + 1);
+
+op_while:
+op_endif:
+	NEXT(ip + 1);
+
+op_while_var:
+	if (vars[ip->operands[0]] != 0) NEXT(base + ip->target);
+	NEXT(ip + 1);
+
+op_endwhile:
+	NEXT(base + ip->target);
+
+op_break_while:
+	counters.resize(counters.size() - ip->pops);
+	NEXT(base + ip->target);
+
+op_for:
+	if (ip->immediate <= 0) NEXT(base + ip->target);
+	counters.push_back(ip->immediate);
+	NEXT(ip + 1);
+
+op_for_var:
+	if (vars[ip->operands[0]] <= 0) NEXT(base + ip->target);
+	counters.push_back(vars[ip->operands[0]]);
+	NEXT(ip + 1);
+
+op_endfor:
+	if (--counters.back() > 0) NEXT(base + ip->target);
+	counters.pop_back();
+	NEXT(ip + 1);
+
+op_integer:
+	vars[ip->operands[0]] = ip->immediate;
+	NEXT(ip + 1);
+
+op_increment:
+	vars[ip->operands[0]] = (int16_t)(vars[ip->operands[0]] + 1);
+	NEXT(ip + 1);
+
+op_decrement:
+	vars[ip->operands[0]] = (int16_t)(vars[ip->operands[0]] - 1);
+	NEXT(ip + 1);
+
+op_add:
+	vars[ip->operands[2]] = (int16_t)(vars[ip->operands[0]] + vars[ip->operands[1]]);
+	NEXT(ip + 1);
+
+op_sub:
+	vars[ip->operands[2]] = (int16_t)(vars[ip->operands[0]] - vars[ip->operands[1]]);
+	NEXT(ip + 1);
+
+op_mul:
+	vars[ip->operands[2]] = (int16_t)(vars[ip->operands[0]] * vars[ip->operands[1]]);
+	NEXT(ip + 1);
+
+op_div:
+	if (vars[ip->operands[1]] == 0) goto divide_by_zero;
+	vars[ip->operands[2]] = (int16_t)(vars[ip->operands[0]] / vars[ip->operands[1]]);
+	NEXT(ip + 1);
+
+op_add_assign:
+	vars[ip->operands[0]] = (int16_t)(vars[ip->operands[0]] + ip->immediate);
+	NEXT(ip + 1);
+
+op_sub_assign:
+	vars[ip->operands[0]] = (int16_t)(vars[ip->operands[0]] - ip->immediate);
+	NEXT(ip + 1);
+
+op_mul_assign:
+	vars[ip->operands[0]] = (int16_t)(vars[ip->operands[0]] * ip->immediate);
+	NEXT(ip + 1);
+
+op_div_assign:
+	if (ip->immediate == 0) goto divide_by_zero;
+	vars[ip->operands[0]] = (int16_t)(vars[ip->operands[0]] / ip->immediate);
+	NEXT(ip + 1);
+
+op_assign:
+	vars[ip->operands[0]] = vars[ip->operands[1]];
+	NEXT(ip + 1);
+
+op_if_z:
+	if (vars[ip->operands[0]] != 0) NEXT(base + ip->target);
+	NEXT(ip + 1);
+
+op_if_nz:
+	if (vars[ip->operands[0]] == 0) NEXT(base + ip->target);
+	NEXT(ip + 1);
+
+op_if_pos:
+	if (vars[ip->operands[0]] <= 0) NEXT(base + ip->target);
+	NEXT(ip + 1);
+
+op_if_neg:
+	if (vars[ip->operands[0]] >= 0) NEXT(base + ip->target);
+	NEXT(ip + 1);
+
+op_end:
+	result = { VM_END, steps, ip->offset, nullptr };
+	return result;
+
+op_invalid:
+	result = { VM_ERROR, steps, ip->offset, "program ended without END" };
+	return result;
+
+divide_by_zero:
+	result = { VM_ERROR, steps, ip->offset, "division by zero" };
+	return result;
+
+out_of_budget:
+	result = { VM_BUDGET, steps, ip->offset, nullptr };
+	return result;
+
+#undef NEXT
+#undef EVENT
+#undef DISPATCH
+}
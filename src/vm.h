@@ -0,0 +1,117 @@
+// reference interpreter for assembled routes
+
+#ifndef VM_H
+#define VM_H
+
+#include "routeasm.h"
+
+// Something a running route asks the vehicle to do:
+// a POINT, POINT_LLA, LAUNCH, LAND or RTL, or a PRINT.
+// Compact points are reported as POINT
+struct RouteEvent {
+	uint8_t opcode;
+	// value printed by PRINT
+	int16_t value;
+	// waypoint coordinates for POINT and POINT_LLA
+	float coords[3];
+	// byte offset of the instruction in the program
+	uint32_t offset;
+	// instructions run up to and including this one
+	uint64_t steps;
+};
+
+enum VmStatus {
+	// END reached
+	VM_END,
+	// step budget used up before END
+	VM_BUDGET,
+	// runtime error, see VmResult::error
+	VM_ERROR
+};
+
+struct VmResult {
+	VmStatus status;
+	// instructions executed
+	uint64_t steps;
+	// byte offset of the instruction the route stopped on
+	uint32_t offset;
+	const char* error;
+};
+
+// Runs the byte format emitted by Assembler.
+//
+// load() decodes the program once, checks block nesting and
+// resolves the target of every branch. Offsets encoded with
+// JUMP_FLAG are checked against the resolved targets, and
+// variables against a SLOT_COUNT the program starts with, so
+// run() only clears the slots it uses. run() then executes
+// with direct threading: each decoded instruction holds the
+// address of its handler and handlers jump straight to the
+// next one (computed goto, with a switch on other compilers).
+//
+// Semantics of the block instructions:
+//  WHILE_VAR x  loops until x is non-zero
+//  ENDWHILE     jumps back to its WHILE or WHILE_VAR
+//  BREAK_WHILE  leaves the innermost while loop
+//  FOR n        runs the body n times, n <= 0 skips it
+//  FOR_VAR x    as FOR with the value of x on entry
+//  IF_x v       skips to after ENDIF unless v is zero,
+//               non-zero, > zero or < zero respectively
+//  ASSIGN a b   copies b into a
+//  POINT_Dn     adds to the step position of the last POINT_Q24
+//               or POINT_Dn run, whichever branch reached it
+// Arithmetic wraps at 16 bits, division by zero is an error.
+class RouteVm {
+public:
+	// decode program, returns false if it is malformed
+	bool load(const uint8_t* program, size_t size);
+	// reason the last load() failed
+	const char* loadError() const { return error; }
+	// byte offset the last load() failed at
+	uint32_t loadErrorOffset() const { return errorOffset; }
+
+	// run from the start with variables zeroed until END or
+	// until budget instructions have run, events are appended
+	// to events when it is not null
+	VmResult run(uint64_t budget, std::vector<RouteEvent>* events = nullptr);
+
+	int16_t variable(uint8_t slot) const { return variables[slot]; }
+
+	// decoded instruction count
+	size_t size() const { return code.size(); }
+	// variable slots the program uses, from its SLOT_COUNT or every slot
+	INT_T slotCount() const { return slots; }
+
+private:
+	struct Instruction {
+		// handler address once threaded
+		const void* handler;
+		// branch target, instruction index
+		uint32_t target;
+		uint32_t offset;
+		union {
+			float coords[3];
+			// compact point steps
+			int32_t quanta[3];
+		};
+		int16_t immediate;
+		uint8_t opcode;
+		uint8_t operands[3];
+		// loop counters to discard on BREAK_WHILE
+		uint8_t pops;
+	};
+
+	bool fail(const char* message, uint32_t offset);
+
+	std::vector<Instruction> code;
+	bool threaded = false;
+	const char* error = nullptr;
+	uint32_t errorOffset = 0;
+
+	int16_t variables[256];
+	INT_T slots = 256;
+	// FOR and FOR_VAR remaining counts
+	std::vector<int32_t> counters;
+};
+
+#endif
@@ -0,0 +1,144 @@
+// checks Geofence::crossing against locate() along each leg
+//
+// A leg between two waypoints inside the fence must be reported by
+// crossing() exactly when some point along it is not inside, as
+// locate() finds at evenly spaced points. Sample legs go through
+// vertices, touch them from outside and run along edges, and random
+// legs join points of a whole metre grid around a fence on it.
+//
+// Usage: geofence_test [legs]
+// legs is the number of random legs, 2000 by default.
+
+#include "routeasm.h"
+#include "geofence.h"
+
+#include <numeric>
+#include <random>
+
+// points tested along each leg, at odd multiples of half of one over
+// this so none is a vertex the leg touches, see main()
+static constexpr INT_T SAMPLES = 1024;
+
+// an exclusion square on round numbers
+static const char* const squareFence =
+	"exclusion\n"
+	"vertex 300 200\n"
+	"vertex 400 200\n"
+	"vertex 400 300\n"
+	"vertex 300 300\n";
+
+// an inclusion with a notch cut into its east side, and two
+// exclusions in it, with edges along and across the grid so points
+// on them are located exactly
+static const char* const gridFence =
+	"inclusion\n"
+	"vertex 0 0\n"
+	"vertex 0 10\n"
+	"vertex 10 10\n"
+	"vertex 10 9\n"
+	"vertex 6 5\n"
+	"vertex 10 1\n"
+	"vertex 10 0\n"
+	"exclusion\n"
+	"vertex 1 4\n"
+	"vertex 3 6\n"
+	"vertex 5 4\n"
+	"vertex 3 2\n"
+	"exclusion\n"
+	"vertex 7 1\n"
+	"vertex 7 2\n"
+	"vertex 8 2\n"
+	"vertex 8 1\n";
+
+struct Leg {
+	const char* fence;
+	double north0, east0, north1, east1;
+	bool leaves;
+};
+
+static const Leg legs[] = {
+	// through two opposite corners of the square
+	{ squareFence, 250, 150, 450, 350, true },
+	{ squareFence, 200, 400, 400, 200, true },
+	// touching one corner from outside
+	{ squareFence, 250, 250, 350, 350, false },
+	{ squareFence, 450, 250, 350, 150, false },
+	// along the south edge, which is in the square, and the north, which is not
+	{ squareFence, 300, 150, 300, 350, true },
+	{ squareFence, 400, 150, 400, 350, false },
+	// touching the notch's tip, and a corner of the diamond
+	{ gridFence, 6, 1, 6, 9, false },
+	{ gridFence, 5, 1, 5, 9, false },
+	// through the tip and across the notch
+	{ gridFence, 2, 5, 9, 5, true },
+	// along a side of the notch, and of the diamond
+	{ gridFence, 10, 9, 6, 5, false },
+	{ gridFence, 6, 3, 2, 7, false },
+};
+
+
+// true if every sampled point of the leg is inside
+static bool staysIn(const Geofence& fence, double north0, double east0, double north1, double east1) {
+	for (INT_T k = 0; k < SAMPLES; ++k) {
+		double t = (k + 0.5) / SAMPLES;
+		if (fence.locate(north0 + t * (north1 - north0), east0 + t * (east1 - east0), 0) != FENCE_INSIDE) return false;
+	}
+	return true;
+}
+
+
+// true if crossing() agrees with sampling, and with expected unless
+// it is negative, otherwise says what was wrong
+static bool check(const Geofence& fence, double north0, double east0, double north1, double east1, INT_T expected) {
+	bool leaves = fence.crossing(north0, east0, north1, east1) >= 0;
+	const char* wrong = nullptr;
+	if (leaves == staysIn(fence, north0, east0, north1, east1)) wrong = leaves ? "every point along it is inside" : "a point along it is outside";
+	else if (expected >= 0 && leaves != (expected != 0)) wrong = "that was not expected";
+	if (!wrong) return true;
+	std::cout << "Error: leg " << north0 << " " << east0 << " to " << north1 << " " << east1 << (leaves ? " leaves" : " stays in")
+		<< " the fence, but " << wrong << "\n";
+	return false;
+}
+
+
+static bool readFence(const char* text, Geofence& fence) {
+	std::string error;
+	if (fence.parse(text, error)) return true;
+	std::cout << "fence" << error << "\n";
+	return false;
+}
+
+
+int main(int argc, char** argv) {
+	INT_T count = argc > 1 ? atoi(argv[1]) : 2000;
+	INT_T failed = 0;
+
+	for (auto& leg : legs) {
+		Geofence fence;
+		if (!readFence(leg.fence, fence)) return 1;
+		failed += !check(fence, leg.north0, leg.east0, leg.north1, leg.east1, leg.leaves);
+		// either way round
+		failed += !check(fence, leg.north1, leg.east1, leg.north0, leg.east0, leg.leaves);
+	}
+
+	Geofence fence;
+	if (!readFence(gridFence, fence)) return 1;
+	std::mt19937 random(1);
+	auto pick = [&]() { return (INT_T)(random() % 13) - 1; };
+	for (INT_T tested = 0; tested < count;) {
+		INT_T north0 = pick(), east0 = pick(), north1 = pick(), east1 = pick();
+		// Vertices on the leg are a multiple of 1 / g of the way along
+		// it, g the greatest common divisor of its steps north and
+		// east. With g a power of two, as the samples are, every point
+		// crossing() and staysIn() locate is exact
+		INT_T g = std::gcd(std::abs(north1 - north0), std::abs(east1 - east0));
+		if (g == 0 || (g & (g - 1)) != 0) continue;
+		// waypoints outside are reported themselves, not their legs
+		if (fence.locate(north0, east0, 0) != FENCE_INSIDE || fence.locate(north1, east1, 0) != FENCE_INSIDE) continue;
+		failed += !check(fence, north0, east0, north1, east1, -1);
+		++tested;
+	}
+
+	std::cout << failed << " of " << 2 * std::size(legs) + count << " legs failed\n";
+	return failed != 0;
+}
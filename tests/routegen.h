@@ -0,0 +1,97 @@
+// random routes for the tests
+//
+// Routes use every block and arithmetic instruction on a few dozen
+// variables, with blocks nested up to five deep. Variables may be
+// read before any write and while loops may never end, so routes
+// should be run with a step budget.
+
+#ifndef ROUTEGEN_H
+#define ROUTEGEN_H
+
+#include "util.h"
+
+#include <random>
+#include <string>
+#include <vector>
+
+class RouteGenerator {
+public:
+	explicit RouteGenerator(uint32_t seed) : random(seed) {}
+
+	std::string route() {
+		enum Block { BLOCK_IF, BLOCK_FOR, BLOCK_WHILE };
+		static const char* const ends[] = { "ENDIF\n", "ENDFOR\n", "ENDWHILE\n" };
+		std::string source;
+		std::vector<Block> blocks;
+		vars = 0;
+		INT_T whiles = 0;
+
+		INT_T lines = 5 + pick(60);
+		for (INT_T i = 0; i < lines; ++i) {
+			INT_T kind = pick(100);
+			bool nest = blocks.size() < 5;
+			if (vars == 0 || kind < 15) {
+				// a new variable, or another write of one
+				INT_T name = vars < 40 && pick(3) ? vars++ : pick(vars + 1);
+				vars = MAX_2(vars, 1);
+				source += "INTEGER x" + std::to_string(name) + " " + std::to_string(pick(7) - 2) + "\n";
+			}
+			else if (kind < 25) source += "PRINT " + var() + "\n";
+			else if (kind < 30) source += "POINT " + std::to_string(pick(9)) + " 1 2\n";
+			else if (kind < 45) {
+				static const char* const ops[] = { "ADD ", "SUB ", "MUL " };
+				source += ops[pick(3)] + var() + " " + var() + " " + var() + "\n";
+			}
+			else if (kind < 55) source += (pick(2) ? "INCREMENT " : "DECREMENT ") + var() + "\n";
+			else if (kind < 60) source += "ASSIGN " + var() + " " + var() + "\n";
+			else if (kind < 63) source += "ADD_ASSIGN " + var() + " " + std::to_string(pick(5)) + "\n";
+			else if (kind < 70 && nest) {
+				static const char* const ops[] = { "IF_Z ", "IF_NZ ", "IF_POS ", "IF_NEG " };
+				source += ops[pick(4)] + var() + "\n";
+				blocks.push_back(BLOCK_IF);
+			}
+			else if (kind < 75 && nest) {
+				source += "FOR " + std::to_string(pick(4)) + "\n";
+				blocks.push_back(BLOCK_FOR);
+			}
+			else if (kind < 78 && nest) {
+				source += "FOR_VAR " + var() + "\n";
+				blocks.push_back(BLOCK_FOR);
+			}
+			else if (kind < 83 && nest) {
+				source += kind < 81 ? "WHILE_VAR " + var() + "\n" : "WHILE\n";
+				blocks.push_back(BLOCK_WHILE);
+				++whiles;
+			}
+			else if (kind < 86 && whiles) source += "BREAK_WHILE\n";
+			else if (kind < 95 && !blocks.empty()) {
+				whiles -= blocks.back() == BLOCK_WHILE;
+				source += ends[blocks.back()];
+				blocks.pop_back();
+			}
+			else source += pick(2) ? "LAND\n" : "LAUNCH\n";
+		}
+		while (!blocks.empty()) {
+			source += ends[blocks.back()];
+			blocks.pop_back();
+		}
+		// read a few variables at the end so their values matter
+		for (INT_T i = 0; i < 3; ++i) source += "PRINT " + var() + "\n";
+		source += "END\n";
+		return source;
+	}
+
+	// a number in [0, n)
+	INT_T pick(INT_T n) { return (INT_T)(random() % (uint32_t)n); }
+
+private:
+	std::string var() {
+		std::string name = "x";
+		return name.append(std::to_string(pick(vars)));
+	}
+
+	std::mt19937 random;
+	INT_T vars = 0;
+};
+
+#endif
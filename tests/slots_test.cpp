@@ -0,0 +1,177 @@
+// checks --reuse-slots leaves what routes do unchanged
+//
+// Each route is assembled with and without slot reuse, with and
+// without -O and --jumps, and run to END or a step budget. Both
+// runs must stop the same way after the same number of steps and
+// record the same events.
+//
+// Usage: slots_test [routes]
+// routes is the number of random routes, 2000 by default.
+
+#include "routeasm.h"
+#include "vm.h"
+#include "routegen.h"
+
+// cuts short routes whose loops do not end
+static constexpr uint64_t BUDGET = 20000;
+
+// written so slots shared by variables in turn are easy to get wrong
+static const char* const routes[] = {
+	// a value kept round a loop while others come and go inside it
+	"INTEGER total 0\n"
+	"FOR 3\n"
+	"	INTEGER a 2\n"
+	"	ADD total total a\n"
+	"	INTEGER b 5\n"
+	"	MUL b b b\n"
+	"	PRINT b\n"
+	"ENDFOR\n"
+	"PRINT total\n"
+	"END\n",
+
+	// read before written, so zero on the first trip and not after
+	"INTEGER again 0\n"
+	"FOR 4\n"
+	"	IF_NZ again\n"
+	"		INTEGER late 7\n"
+	"	ENDIF\n"
+	"	PRINT late\n"
+	"	INTEGER other 9\n"
+	"	PRINT other\n"
+	"	INCREMENT again\n"
+	"ENDFOR\n"
+	"END\n",
+
+	// a while loop whose break skips the write the loop test reads
+	"INTEGER n 3\n"
+	"INTEGER done 0\n"
+	"WHILE_VAR done\n"
+	"	DECREMENT n\n"
+	"	IF_Z n\n"
+	"		BREAK_WHILE\n"
+	"	ENDIF\n"
+	"	INTEGER t 4\n"
+	"	PRINT t\n"
+	"	POINT 1 2 3\n"
+	"ENDWHILE\n"
+	"PRINT n\n"
+	"LAND\n"
+	"END\n",
+
+	// an IF closing and a sibling while opening at the same depth
+	"INTEGER k 2\n"
+	"WHILE\n"
+	"	IF_POS k\n"
+	"		INTEGER u 1\n"
+	"		PRINT u\n"
+	"	ENDIF\n"
+	"	WHILE_VAR k\n"
+	"		BREAK_WHILE\n"
+	"	ENDWHILE\n"
+	"	DECREMENT k\n"
+	"	IF_NEG k\n"
+	"		BREAK_WHILE\n"
+	"	ENDIF\n"
+	"	INTEGER v 6\n"
+	"	PRINT v\n"
+	"ENDWHILE\n"
+	"PRINT k\n"
+	"END\n",
+
+	// copies, which may share a slot with what they copy
+	"INTEGER a 3\n"
+	"INTEGER b 0\n"
+	"INTEGER c 0\n"
+	"ASSIGN b a\n"
+	"INCREMENT b\n"
+	"ASSIGN c b\n"
+	"PRINT a\n"
+	"PRINT c\n"
+	"FOR_VAR c\n"
+	"	POINT 4 5 6\n"
+	"ENDFOR\n"
+	"END\n",
+};
+
+
+struct Run {
+	VmResult result;
+	std::vector<RouteEvent> events;
+};
+
+
+// assemble and run source, false with a message if either fails
+static bool run(const std::string& source, const AssemblerOptions& options, Run& run) {
+	Assembler assembler;
+	assembler.options = options;
+	if (!assembler.assemble("route", source)) {
+		std::string log;
+		assembler.diagnostics.format(log);
+		std::cout << log;
+		return false;
+	}
+	RouteVm vm;
+	if (!vm.load(assembler.data.data(), assembler.data.size())) {
+		std::cout << "Error: " << vm.loadError() << " at offset " << vm.loadErrorOffset() << "\n";
+		return false;
+	}
+	run.result = vm.run(BUDGET, &run.events);
+	return true;
+}
+
+
+static bool sameEvent(const RouteEvent& a, const RouteEvent& b) {
+	return a.opcode == b.opcode && a.value == b.value && memcmp(a.coords, b.coords, sizeof(a.coords)) == 0;
+}
+
+
+// true if source does the same with and without slot reuse under
+// every option set, otherwise says what differed
+static bool check(const std::string& source) {
+	for (INT_T set = 0; set < 4; ++set) {
+		AssemblerOptions options;
+		options.optimize = set & 1;
+		options.jumpOffsets = set & 2;
+		Run plain, reused;
+		if (!run(source, options, plain)) return false;
+		options.reuseSlots = true;
+		if (!run(source, options, reused)) return false;
+
+		const char* differs = nullptr;
+		if (plain.result.status != reused.result.status) differs = "status";
+		else if (plain.result.steps != reused.result.steps) differs = "steps";
+		else if (plain.events.size() != reused.events.size()) differs = "event count";
+		for (size_t i = 0; !differs && i < plain.events.size(); ++i) {
+			if (!sameEvent(plain.events[i], reused.events[i])) differs = "events";
+		}
+		if (differs) {
+			std::cout << "Error: " << differs << " differ with slot reuse" << (options.optimize ? ", -O" : "")
+				<< (options.jumpOffsets ? ", --jumps" : "") << "\n";
+			return false;
+		}
+	}
+	return true;
+}
+
+
+int main(int argc, char** argv) {
+	INT_T count = argc > 1 ? atoi(argv[1]) : 2000;
+	INT_T failed = 0;
+
+	for (const char* source : routes) {
+		if (!check(source)) {
+			std::cout << source << "\n";
+			++failed;
+		}
+	}
+	for (INT_T seed = 0; seed < count; ++seed) {
+		std::string source = RouteGenerator((uint32_t)seed).route();
+		if (!check(source)) {
+			std::cout << "random route " << seed << ":\n" << source << "\n";
+			++failed;
+		}
+	}
+
+	std::cout << failed << " of " << std::size(routes) + count << " routes failed\n";
+	return failed != 0;
+}
@@ -0,0 +1,160 @@
+// checks the step analysis bounds what routes run between events
+//
+// Each route is assembled with and without -O, --jumps and compact
+// waypoints, and run to END or a step budget. Every stretch the run
+// goes through, from a waypoint or flight mode change or the start
+// up to and including the next one or END, must be no longer than
+// the longest stretch analyzeSteps finds. Routes with no branches
+// but FOR loops must reach it.
+//
+// Usage: steps_test [routes]
+// routes is the number of random routes, 2000 by default.
+
+#include "routeasm.h"
+#include "steps.h"
+#include "vm.h"
+#include "routegen.h"
+
+// cuts short routes whose loops do not end
+static constexpr uint64_t BUDGET = 20000;
+
+struct Sample {
+	const char* source;
+	// every path is taken, so the longest stretch is run
+	bool exact;
+};
+
+static const Sample samples[] = {
+	// the longest stretch is after the start, not the first one
+	{ "INTEGER n 5\n"
+	  "INTEGER x 0\n"
+	  "POINT 0 0 0\n"
+	  "FOR 10\n"
+	  "	INCREMENT x\n"
+	  "ENDFOR\n"
+	  "POINT 1 1 1\n"
+	  "FOR_VAR n\n"
+	  "	FOR 3\n"
+	  "		DECREMENT x\n"
+	  "	ENDFOR\n"
+	  "ENDFOR\n"
+	  "LAND\n"
+	  "END\n", true },
+
+	// waypoints inside a loop split it into stretches round the loop
+	{ "INTEGER x 0\n"
+	  "LAUNCH\n"
+	  "FOR 4\n"
+	  "	POINT 1 2 3\n"
+	  "	FOR 6\n"
+	  "		ADD_ASSIGN x 2\n"
+	  "	ENDFOR\n"
+	  "	PRINT x\n"
+	  "ENDFOR\n"
+	  "RTL\n"
+	  "END\n", true },
+
+	// a waypoint only some trips reach, and one every trip reaches, so
+	// the longest stretch runs round the loop from one to the next
+	{ "INTEGER x 0\n"
+	  "POINT 0 0 0\n"
+	  "WHILE\n"
+	  "	INCREMENT x\n"
+	  "	IF_POS x\n"
+	  "		SUB_ASSIGN x 3\n"
+	  "		POINT 5 5 5\n"
+	  "	ENDIF\n"
+	  "	IF_Z x\n"
+	  "		BREAK_WHILE\n"
+	  "	ENDIF\n"
+	  "	POINT 1 1 1\n"
+	  "ENDWHILE\n"
+	  "POINT 2 2 2\n"
+	  "END\n", false },
+
+	// a while loop that ends, but is not known to
+	{ "INTEGER x 0\n"
+	  "POINT 0 0 0\n"
+	  "WHILE_VAR x\n"
+	  "	INCREMENT x\n"
+	  "ENDWHILE\n"
+	  "POINT 1 1 1\n"
+	  "END\n", false },
+};
+
+
+// true if the longest stretch of source is bounded by the analysis,
+// and reached when exact, under every option set, otherwise says
+// what was wrong
+static bool check(const std::string& source, bool exact) {
+	for (INT_T set = 0; set < 8; ++set) {
+		AssemblerOptions options;
+		options.optimize = set & 1;
+		options.jumpOffsets = set & 2;
+		options.pointResolution = set & 4 ? 0.5f : 0;
+		Assembler assembler;
+		assembler.options = options;
+		if (!assembler.assemble("route", source)) {
+			std::string log;
+			assembler.diagnostics.format(log);
+			std::cout << log;
+			return false;
+		}
+		StepReport report;
+		INT_T at;
+		if (!analyzeSteps(assembler.instructions, report, at)) {
+			std::cout << "Error: steps not counted at instruction " << at << "\n";
+			return false;
+		}
+		RouteVm vm;
+		if (!vm.load(assembler.data.data(), assembler.data.size())) {
+			std::cout << "Error: " << vm.loadError() << " at offset " << vm.loadErrorOffset() << "\n";
+			return false;
+		}
+		std::vector<RouteEvent> events;
+		VmResult result = vm.run(BUDGET, &events);
+
+		// PRINT is not an event for the analysis
+		uint64_t last = 0, longest = 0;
+		for (auto& event : events) {
+			if (event.opcode == PRINT) continue;
+			longest = MAX_2(longest, event.steps - last);
+			last = event.steps;
+		}
+		if (result.status == VM_END) longest = MAX_2(longest, result.steps - last);
+
+		const char* wrong = nullptr;
+		if (report.worst != STEPS_UNBOUNDED && longest > (uint64_t)report.worst) wrong = "over";
+		else if (exact && result.status == VM_END && longest != (uint64_t)report.worst) wrong = "short of";
+		if (wrong) {
+			std::cout << "Error: ran " << longest << " instructions between events, " << wrong << " the " << report.worst
+				<< " counted" << (options.optimize ? ", -O" : "") << (options.jumpOffsets ? ", --jumps" : "")
+				<< (options.pointResolution > 0 ? ", --point-resolution" : "") << "\n";
+			return false;
+		}
+	}
+	return true;
+}
+
+
+int main(int argc, char** argv) {
+	INT_T count = argc > 1 ? atoi(argv[1]) : 2000;
+	INT_T failed = 0;
+
+	for (auto& sample : samples) {
+		if (!check(sample.source, sample.exact)) {
+			std::cout << sample.source << "\n";
+			++failed;
+		}
+	}
+	for (INT_T seed = 0; seed < count; ++seed) {
+		std::string source = RouteGenerator((uint32_t)seed).route();
+		if (!check(source, false)) {
+			std::cout << "random route " << seed << ":\n" << source << "\n";
+			++failed;
+		}
+	}
+
+	std::cout << failed << " of " << std::size(samples) + count << " routes failed\n";
+	return failed != 0;
+}